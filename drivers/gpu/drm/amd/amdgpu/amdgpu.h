@@ -152,6 +152,7 @@ extern unsigned int amdgpu_vram_limit;
 extern int amdgpu_vis_vram_limit;
 extern int amdgpu_gart_size;
 extern int amdgpu_gtt_size;
+extern int amdgpu_vram_reclaim;
 extern int amdgpu_moverate;
 extern int amdgpu_audio;
 extern int amdgpu_disp_priority;
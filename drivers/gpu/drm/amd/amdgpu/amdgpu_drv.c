@@ -128,6 +128,7 @@ unsigned int amdgpu_vram_limit = UINT_MAX;
 int amdgpu_vis_vram_limit;
 int amdgpu_gart_size = -1; /* auto */
 int amdgpu_gtt_size = -1; /* auto */
+int amdgpu_vram_reclaim = 95;
 int amdgpu_moverate = -1; /* auto */
 int amdgpu_audio = -1;
 int amdgpu_disp_priority;
@@ -274,6 +275,14 @@ module_param_named(gartsize, amdgpu_gart_size, uint, 0600);
 MODULE_PARM_DESC(gttsize, "Size of the GTT userspace domain in megabytes (-1 = auto)");
 module_param_named(gttsize, amdgpu_gtt_size, int, 0600);
 
+/**
+ * DOC: vram_reclaim (int)
+ * Start evicting from VRAM in the background once this percentage of it is
+ * in use, until usage is 5% lower again. The default is 95, 0 disables it.
+ */
+MODULE_PARM_DESC(vram_reclaim, "VRAM usage in percent above which to evict in the background (95 = default, 0 = off)");
+module_param_named(vram_reclaim, amdgpu_vram_reclaim, int, 0444);
+
 /**
  * DOC: moverate (int)
  * Set maximum buffer migration rate in MB/s. The default is -1 (8 MB/s).
@@ -2831,6 +2840,32 @@ const struct drm_ioctl_desc amdgpu_ioctls_kms[] = {
 	DRM_IOCTL_DEF_DRV(AMDGPU_GEM_USERPTR, amdgpu_gem_userptr_ioctl, DRM_AUTH|DRM_RENDER_ALLOW),
 };
 
+#ifdef __FreeBSD__
+static void amdgpu_stats_sysctl_init(struct drm_device *dev,
+				     struct sysctl_ctx_list *ctx,
+				     struct sysctl_oid *node)
+{
+	struct amdgpu_device *adev = drm_to_adev(dev);
+	struct sysctl_oid *sched;
+	int i;
+
+	ttm_pool_sysctl_init(&adev->mman.bdev.pool, ctx, node);
+
+	sched = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "sched",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "GPU scheduler rings");
+	if (sched == NULL)
+		return;
+
+	for (i = 0; i < AMDGPU_MAX_RINGS; ++i) {
+		struct amdgpu_ring *ring = adev->rings[i];
+
+		if (!ring || ring->no_scheduler)
+			continue;
+		drm_sched_sysctl_init(&ring->sched, ctx, sched);
+	}
+}
+#endif
+
 static const struct drm_driver amdgpu_kms_driver = {
 	.driver_features =
 	    DRIVER_ATOMIC |
@@ -2849,6 +2884,9 @@ static const struct drm_driver amdgpu_kms_driver = {
 #ifdef CONFIG_PROC_FS
 	.show_fdinfo = amdgpu_show_fdinfo,
 #endif
+#ifdef __FreeBSD__
+	.stats_sysctl_init = amdgpu_stats_sysctl_init,
+#endif
 
 	.gem_prime_import = amdgpu_gem_prime_import,
 
@@ -329,15 +329,31 @@ int amdgpu_ib_schedule(struct amdgpu_ring *ring, unsigned int num_ibs,
  */
 int amdgpu_ib_pool_init(struct amdgpu_device *adev)
 {
+	unsigned int num_shards;
 	int r, i;
 
 	if (adev->ib_pool_ready)
 		return 0;
 
 	for (i = 0; i < AMDGPU_IB_POOL_MAX; i++) {
+		/*
+		 * Give each CPU its own sub-ring of the kernel IB pools so that
+		 * submissions from different threads don't serialize on one
+		 * lock, but keep every shard large enough for the biggest
+		 * kernel IBs. User IBs of parse_cs rings are sized by userspace
+		 * and may take the whole delayed pool, so it isn't sharded.
+		 */
+		if (i == AMDGPU_IB_POOL_DELAYED)
+			num_shards = 1;
+		else
+			num_shards = min_t(unsigned int, num_online_cpus(),
+					   AMDGPU_IB_POOL_SIZE /
+					   AMDGPU_IB_POOL_SHARD_SIZE);
+
 		r = amdgpu_sa_bo_manager_init(adev, &adev->ib_pools[i],
 					      AMDGPU_IB_POOL_SIZE, 256,
-					      AMDGPU_GEM_DOMAIN_GTT);
+					      AMDGPU_GEM_DOMAIN_GTT,
+					      num_shards);
 		if (r)
 			goto error;
 	}
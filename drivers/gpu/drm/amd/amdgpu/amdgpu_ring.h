@@ -66,6 +66,7 @@ enum amdgpu_ring_priority_level {
 #define to_amdgpu_ring(s) container_of((s), struct amdgpu_ring, sched)
 
 #define AMDGPU_IB_POOL_SIZE	(1024 * 1024)
+#define AMDGPU_IB_POOL_SHARD_SIZE	(256 * 1024)
 
 enum amdgpu_ring_type {
 	AMDGPU_RING_TYPE_GFX		= AMDGPU_HW_IP_GFX,
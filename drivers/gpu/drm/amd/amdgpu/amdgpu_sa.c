@@ -46,7 +46,8 @@
 
 int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
 			      struct amdgpu_sa_manager *sa_manager,
-			      unsigned int size, u32 suballoc_align, u32 domain)
+			      unsigned int size, u32 suballoc_align, u32 domain,
+			      unsigned int num_shards)
 {
 	int r;
 
@@ -59,7 +60,11 @@ int amdgpu_sa_bo_manager_init(struct amdgpu_device *adev,
 	}
 
 	memset(sa_manager->cpu_ptr, 0, size);
-	drm_suballoc_manager_init(&sa_manager->base, size, suballoc_align);
+	r = drm_suballoc_manager_init_sharded(&sa_manager->base, size,
+					      suballoc_align, num_shards);
+	if (r)
+		amdgpu_bo_free_kernel(&sa_manager->bo, &sa_manager->gpu_addr,
+				      &sa_manager->cpu_ptr);
 	return r;
 }
 
@@ -884,6 +884,7 @@ int amdgpu_vram_mgr_init(struct amdgpu_device *adev)
 {
 	struct amdgpu_vram_mgr *mgr = &adev->mman.vram_mgr;
 	struct ttm_resource_manager *man = &mgr->manager;
+	uint64_t high;
 	int err;
 
 	ttm_resource_manager_init(man, &adev->mman.bdev,
@@ -900,6 +901,19 @@ int amdgpu_vram_mgr_init(struct amdgpu_device *adev)
 		err = drm_buddy_init(&mgr->mm, man->size, PAGE_SIZE);
 		if (err)
 			return err;
+
+		err = drm_buddy_cache_init(&mgr->mm);
+		if (err) {
+			drm_buddy_fini(&mgr->mm);
+			return err;
+		}
+
+		/* Evict in the background before allocations run out of VRAM */
+		if (amdgpu_vram_reclaim > 5 && amdgpu_vram_reclaim <= 100) {
+			high = div_u64(man->size * amdgpu_vram_reclaim, 100);
+			ttm_resource_manager_set_watermarks(man,
+				high - div_u64(man->size * 5, 100), high);
+		}
 	} else {
 		man->func = &amdgpu_dummy_vram_mgr_func;
 		DRM_INFO("Setup dummy vram mgr\n");
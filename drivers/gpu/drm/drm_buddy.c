@@ -3,14 +3,22 @@
  * Copyright © 2021 Intel Corporation
  */
 
+#include <linux/cpumask.h>
 #include <linux/kmemleak.h>
 #include <linux/module.h>
 #include <linux/sizes.h>
+#include <linux/smp.h>
 
 #include <drm/drm_buddy.h>
 
+#ifdef __FreeBSD__
+#include "drm_trace_freebsd.h"
+#endif
+
 static struct kmem_cache *slab_blocks;
 
+static bool cache_drain(struct drm_buddy *mm);
+
 static struct drm_buddy_block *drm_block_alloc(struct drm_buddy *mm,
 					       struct drm_buddy_block *parent,
 					       unsigned int order,
@@ -38,31 +46,67 @@ static void drm_block_free(struct drm_buddy *mm,
 	kmem_cache_free(slab_blocks, block);
 }
 
-static void list_insert_sorted(struct drm_buddy *mm,
-			       struct drm_buddy_block *block)
+static inline u64 rb_to_block_offset(struct rb_node *rb)
 {
-	struct drm_buddy_block *node;
-	struct list_head *head;
+	return drm_buddy_block_offset(rb_entry(rb, struct drm_buddy_block, rb));
+}
 
-	head = &mm->free_list[drm_buddy_block_order(block)];
-	if (list_empty(head)) {
-		list_add(&block->link, head);
-		return;
+static void free_tree_insert(struct drm_buddy *mm,
+			     struct drm_buddy_block *block)
+{
+	unsigned int order = drm_buddy_block_order(block);
+	struct rb_root_cached *root = &mm->free_tree[order];
+	struct rb_node **link = &root->rb_root.rb_node, *rb = NULL;
+	u64 offset = drm_buddy_block_offset(block);
+	bool first = true;
+
+	while (*link) {
+		rb = *link;
+		if (offset > rb_to_block_offset(rb)) {
+			link = &rb->rb_left;
+		} else {
+			link = &rb->rb_right;
+			first = false;
+		}
 	}
 
-	list_for_each_entry(node, head, link)
-		if (drm_buddy_block_offset(block) < drm_buddy_block_offset(node))
-			break;
+	rb_link_node(&block->rb, rb, link);
+	rb_insert_color_cached(&block->rb, root, first);
+	__set_bit(order, mm->free_orders);
+}
+
+static void free_tree_remove(struct drm_buddy *mm,
+			     struct drm_buddy_block *block)
+{
+	unsigned int order = drm_buddy_block_order(block);
+	struct rb_root_cached *root = &mm->free_tree[order];
 
-	__list_add(&block->link, node->link.prev, &node->link);
+	rb_erase_cached(&block->rb, root);
+	RB_CLEAR_NODE(&block->rb);
+	if (RB_EMPTY_ROOT(&root->rb_root))
+		__clear_bit(order, mm->free_orders);
 }
 
-static void mark_allocated(struct drm_buddy_block *block)
+static struct drm_buddy_block *
+free_tree_highest(struct drm_buddy *mm, unsigned int order)
+{
+	return rb_entry_safe(rb_first_cached(&mm->free_tree[order]),
+			     struct drm_buddy_block, rb);
+}
+
+static inline bool has_free_order(struct drm_buddy *mm, unsigned int order)
+{
+	return find_next_bit(mm->free_orders, mm->max_order + 1, order) <=
+	       mm->max_order;
+}
+
+static void mark_allocated(struct drm_buddy *mm,
+			   struct drm_buddy_block *block)
 {
 	block->header &= ~DRM_BUDDY_HEADER_STATE;
 	block->header |= DRM_BUDDY_ALLOCATED;
 
-	list_del(&block->link);
+	free_tree_remove(mm, block);
 }
 
 static void mark_free(struct drm_buddy *mm,
@@ -71,15 +115,16 @@ static void mark_free(struct drm_buddy *mm,
 	block->header &= ~DRM_BUDDY_HEADER_STATE;
 	block->header |= DRM_BUDDY_FREE;
 
-	list_insert_sorted(mm, block);
+	free_tree_insert(mm, block);
 }
 
-static void mark_split(struct drm_buddy_block *block)
+static void mark_split(struct drm_buddy *mm,
+		       struct drm_buddy_block *block)
 {
 	block->header &= ~DRM_BUDDY_HEADER_STATE;
 	block->header |= DRM_BUDDY_SPLIT;
 
-	list_del(&block->link);
+	free_tree_remove(mm, block);
 }
 
 /**
@@ -114,17 +159,19 @@ int drm_buddy_init(struct drm_buddy *mm, u64 size, u64 chunk_size)
 	mm->avail = size;
 	mm->chunk_size = chunk_size;
 	mm->max_order = ilog2(size) - ilog2(chunk_size);
+	mm->cache = NULL;
 
 	BUG_ON(mm->max_order > DRM_BUDDY_MAX_ORDER);
 
-	mm->free_list = kmalloc_array(mm->max_order + 1,
-				      sizeof(struct list_head),
+	mm->free_tree = kmalloc_array(mm->max_order + 1,
+				      sizeof(struct rb_root_cached),
 				      GFP_KERNEL);
-	if (!mm->free_list)
+	if (!mm->free_tree)
 		return -ENOMEM;
 
 	for (i = 0; i <= mm->max_order; ++i)
-		INIT_LIST_HEAD(&mm->free_list[i]);
+		mm->free_tree[i] = RB_ROOT_CACHED;
+	bitmap_zero(mm->free_orders, DRM_BUDDY_MAX_ORDER + 1);
 
 	mm->n_roots = hweight64(size);
 
@@ -132,7 +179,7 @@ int drm_buddy_init(struct drm_buddy *mm, u64 size, u64 chunk_size)
 				  sizeof(struct drm_buddy_block *),
 				  GFP_KERNEL);
 	if (!mm->roots)
-		goto out_free_list;
+		goto out_free_tree;
 
 	offset = 0;
 	i = 0;
@@ -171,8 +218,8 @@ out_free_roots:
 	while (i--)
 		drm_block_free(mm, mm->roots[i]);
 	kfree(mm->roots);
-out_free_list:
-	kfree(mm->free_list);
+out_free_tree:
+	kfree(mm->free_tree);
 	return -ENOMEM;
 }
 EXPORT_SYMBOL(drm_buddy_init);
@@ -188,6 +235,9 @@ void drm_buddy_fini(struct drm_buddy *mm)
 {
 	int i;
 
+	cache_drain(mm);
+	kfree(mm->cache);
+
 	for (i = 0; i < mm->n_roots; ++i) {
 		WARN_ON(!drm_buddy_block_is_free(mm->roots[i]));
 		drm_block_free(mm, mm->roots[i]);
@@ -196,7 +246,7 @@ void drm_buddy_fini(struct drm_buddy *mm)
 	WARN_ON(mm->avail != mm->size);
 
 	kfree(mm->roots);
-	kfree(mm->free_list);
+	kfree(mm->free_tree);
 }
 EXPORT_SYMBOL(drm_buddy_fini);
 
@@ -223,7 +273,7 @@ static int split_block(struct drm_buddy *mm,
 	mark_free(mm, block->left);
 	mark_free(mm, block->right);
 
-	mark_split(block);
+	mark_split(mm, block);
 
 	return 0;
 }
@@ -273,7 +323,7 @@ static void __drm_buddy_free(struct drm_buddy *mm,
 		if (!drm_buddy_block_is_free(buddy))
 			break;
 
-		list_del(&buddy->link);
+		free_tree_remove(mm, buddy);
 
 		drm_block_free(mm, block);
 		drm_block_free(mm, buddy);
@@ -284,6 +334,114 @@ static void __drm_buddy_free(struct drm_buddy *mm,
 	mark_free(mm, block);
 }
 
+/*
+ * Magazine of small blocks. Freed blocks of the cached orders are kept,
+ * still marked as allocated in the tree, and handed out again to plain
+ * allocations of the same size without splitting or walking the free trees.
+ * The magazine is refilled and drained in batches, and cached blocks are
+ * accounted as available in mm->avail.
+ *
+ * Like the rest of the manager the magazine is serialised by the caller, so
+ * there is a single one shared by all users of the manager.
+ */
+#define DRM_BUDDY_CACHE_ORDERS	5
+#define DRM_BUDDY_CACHE_SIZE	16
+#define DRM_BUDDY_CACHE_BATCH	(DRM_BUDDY_CACHE_SIZE / 2)
+
+struct drm_buddy_magazine {
+	unsigned int count[DRM_BUDDY_CACHE_ORDERS];
+	struct drm_buddy_block *blocks[DRM_BUDDY_CACHE_ORDERS][DRM_BUDDY_CACHE_SIZE];
+	u64 hits;
+	u64 misses;
+	u64 refills;
+	u64 drains;
+};
+
+static struct drm_buddy_block *cache_get(struct drm_buddy *mm,
+					 unsigned int order)
+{
+	struct drm_buddy_magazine *mag = mm->cache;
+	struct drm_buddy_block *block = NULL;
+
+	if (mag->count[order]) {
+		block = mag->blocks[order][--mag->count[order]];
+		mag->hits++;
+	} else {
+		mag->misses++;
+	}
+
+	return block;
+}
+
+static bool cache_put(struct drm_buddy *mm, struct drm_buddy_block *block)
+{
+	unsigned int order = drm_buddy_block_order(block);
+	struct drm_buddy_magazine *mag;
+	unsigned int i, n;
+
+	if (!mm->cache || order >= DRM_BUDDY_CACHE_ORDERS)
+		return false;
+
+	mag = mm->cache;
+	if (mag->count[order] == DRM_BUDDY_CACHE_SIZE) {
+		/* Return the oldest half to the tree. */
+		n = DRM_BUDDY_CACHE_BATCH;
+		for (i = 0; i < n; i++)
+			__drm_buddy_free(mm, mag->blocks[order][i]);
+		memmove(mag->blocks[order], &mag->blocks[order][n],
+			(DRM_BUDDY_CACHE_SIZE - n) * sizeof(*mag->blocks[order]));
+		mag->count[order] -= n;
+		mag->drains++;
+	}
+	mag->blocks[order][mag->count[order]++] = block;
+
+	return true;
+}
+
+static bool cache_drain(struct drm_buddy *mm)
+{
+	struct drm_buddy_magazine *mag = mm->cache;
+	unsigned int order, i;
+	bool drained = false;
+
+	if (!mag)
+		return false;
+
+	for (order = 0; order < DRM_BUDDY_CACHE_ORDERS; order++) {
+		for (i = 0; i < mag->count[order]; i++)
+			__drm_buddy_free(mm, mag->blocks[order][i]);
+		drained |= mag->count[order];
+		mag->count[order] = 0;
+	}
+
+	return drained;
+}
+
+/**
+ * drm_buddy_cache_init - enable the small block cache
+ *
+ * @mm: DRM buddy manager
+ *
+ * Puts a magazine of pre-split blocks in front of the free trees for the
+ * smallest orders. Plain (neither range nor top-down) allocations of a
+ * single cached-order block, and frees of such blocks, are then served from
+ * the magazine. Cached blocks are returned to the tree when the free trees
+ * have no block of the order an allocation starts with, when an allocation
+ * would otherwise fail and on drm_buddy_fini().
+ *
+ * Returns:
+ * 0 on success, error code on failure.
+ */
+int drm_buddy_cache_init(struct drm_buddy *mm)
+{
+	mm->cache = kzalloc(sizeof(*mm->cache), GFP_KERNEL);
+	if (!mm->cache)
+		return -ENOMEM;
+
+	return 0;
+}
+EXPORT_SYMBOL(drm_buddy_cache_init);
+
 /**
  * drm_buddy_free_block - free a block
  *
@@ -294,7 +452,15 @@ void drm_buddy_free_block(struct drm_buddy *mm,
 			  struct drm_buddy_block *block)
 {
 	BUG_ON(!drm_buddy_block_is_allocated(block));
+#ifdef __FreeBSD__
+	trace_drm_free(DRM_ALLOC_TRACE_BUDDY, mm,
+		       drm_buddy_block_offset(block),
+		       drm_buddy_block_size(mm, block));
+#endif
 	mm->avail += drm_buddy_block_size(mm, block);
+	if (cache_put(mm, block))
+		return;
+
 	__drm_buddy_free(mm, block);
 }
 EXPORT_SYMBOL(drm_buddy_free_block);
@@ -338,6 +504,10 @@ alloc_range_bias(struct drm_buddy *mm,
 	int err;
 	int i;
 
+	/* Only free blocks of at least @order can satisfy the request. */
+	if (!has_free_order(mm, order))
+		return ERR_PTR(-ENOSPC);
+
 	end = end - 1;
 
 	for (i = 0; i < mm->n_roots; ++i)
@@ -408,23 +578,16 @@ static struct drm_buddy_block *
 get_maxblock(struct drm_buddy *mm, unsigned int order)
 {
 	struct drm_buddy_block *max_block = NULL, *node;
-	unsigned int i;
-
-	for (i = order; i <= mm->max_order; ++i) {
-		if (!list_empty(&mm->free_list[i])) {
-			node = list_last_entry(&mm->free_list[i],
-					       struct drm_buddy_block,
-					       link);
-			if (!max_block) {
-				max_block = node;
-				continue;
-			}
 
-			if (drm_buddy_block_offset(node) >
-			    drm_buddy_block_offset(max_block)) {
-				max_block = node;
-			}
-		}
+	for (order = find_next_bit(mm->free_orders, mm->max_order + 1, order);
+	     order <= mm->max_order;
+	     order = find_next_bit(mm->free_orders, mm->max_order + 1,
+				   order + 1)) {
+		node = free_tree_highest(mm, order);
+		if (!max_block ||
+		    drm_buddy_block_offset(node) >
+		    drm_buddy_block_offset(max_block))
+			max_block = node;
 	}
 
 	return max_block;
@@ -445,15 +608,9 @@ alloc_from_freelist(struct drm_buddy *mm,
 			/* Store the obtained block order */
 			tmp = drm_buddy_block_order(block);
 	} else {
-		for (tmp = order; tmp <= mm->max_order; ++tmp) {
-			if (!list_empty(&mm->free_list[tmp])) {
-				block = list_last_entry(&mm->free_list[tmp],
-							struct drm_buddy_block,
-							link);
-				if (block)
-					break;
-			}
-		}
+		tmp = find_next_bit(mm->free_orders, mm->max_order + 1, order);
+		if (tmp <= mm->max_order)
+			block = free_tree_highest(mm, tmp);
 	}
 
 	if (!block)
@@ -519,8 +676,12 @@ static int __alloc_range(struct drm_buddy *mm,
 				goto err_free;
 			}
 
-			mark_allocated(block);
+			mark_allocated(mm, block);
 			mm->avail -= drm_buddy_block_size(mm, block);
+#ifdef __FreeBSD__
+			trace_drm_alloc(DRM_ALLOC_TRACE_BUDDY, mm, block_start,
+					drm_buddy_block_size(mm, block), 0);
+#endif
 			list_add_tail(&block->link, &allocated);
 			continue;
 		}
@@ -617,6 +778,11 @@ int drm_buddy_block_trim(struct drm_buddy *mm,
 		return 0;
 
 	list_del(&block->link);
+#ifdef __FreeBSD__
+	trace_drm_free(DRM_ALLOC_TRACE_BUDDY, mm,
+		       drm_buddy_block_offset(block),
+		       drm_buddy_block_size(mm, block));
+#endif
 	mark_free(mm, block);
 	mm->avail += drm_buddy_block_size(mm, block);
 
@@ -628,8 +794,12 @@ int drm_buddy_block_trim(struct drm_buddy *mm,
 	list_add(&block->tmp_link, &dfs);
 	err =  __alloc_range(mm, &dfs, new_start, new_size, blocks);
 	if (err) {
-		mark_allocated(block);
+		mark_allocated(mm, block);
 		mm->avail -= drm_buddy_block_size(mm, block);
+#ifdef __FreeBSD__
+		trace_drm_alloc(DRM_ALLOC_TRACE_BUDDY, mm, new_start,
+				drm_buddy_block_size(mm, block), 0);
+#endif
 		list_add(&block->link, blocks);
 	}
 
@@ -638,62 +808,84 @@ int drm_buddy_block_trim(struct drm_buddy *mm,
 }
 EXPORT_SYMBOL(drm_buddy_block_trim);
 
-/**
- * drm_buddy_alloc_blocks - allocate power-of-two blocks
- *
- * @mm: DRM buddy manager to allocate from
- * @start: start of the allowed range for this block
- * @end: end of the allowed range for this block
- * @size: size of the allocation
- * @min_page_size: alignment of the allocation
- * @blocks: output list head to add allocated blocks
- * @flags: DRM_BUDDY_*_ALLOCATION flags
- *
- * alloc_range_bias() called on range limitations, which traverses
- * the tree and returns the desired block.
- *
- * alloc_from_freelist() called when *no* range restrictions
- * are enforced, which picks the block from the freelist.
- *
- * Returns:
- * 0 on success, error code on failure.
- */
-int drm_buddy_alloc_blocks(struct drm_buddy *mm,
-			   u64 start, u64 end, u64 size,
-			   u64 min_page_size,
-			   struct list_head *blocks,
-			   unsigned long flags)
+static struct drm_buddy_block *cache_refill(struct drm_buddy *mm,
+					    unsigned int order)
 {
-	struct drm_buddy_block *block = NULL;
-	unsigned int min_order, order;
-	unsigned long pages;
-	LIST_HEAD(allocated);
-	int err;
+	struct drm_buddy_block *fill[DRM_BUDDY_CACHE_BATCH];
+	struct drm_buddy_magazine *mag;
+	struct drm_buddy_block *block;
+	unsigned int i, n;
 
-	if (size < mm->chunk_size)
-		return -EINVAL;
+	for (n = 0; n < DRM_BUDDY_CACHE_BATCH; n++) {
+		block = alloc_from_freelist(mm, order, 0);
+		if (IS_ERR(block))
+			break;
 
-	if (min_page_size < mm->chunk_size)
-		return -EINVAL;
+		mark_allocated(mm, block);
+		fill[n] = block;
+	}
 
-	if (!is_power_of_2(min_page_size))
-		return -EINVAL;
+	if (!n)
+		return NULL;
 
-	if (!IS_ALIGNED(start | end | size, mm->chunk_size))
-		return -EINVAL;
+	/* Keep the last one for the caller, stash the rest. */
+	block = fill[--n];
 
-	if (end > mm->size)
-		return -EINVAL;
+	mag = mm->cache;
+	for (i = 0; i < n && mag->count[order] < DRM_BUDDY_CACHE_SIZE; i++)
+		mag->blocks[order][mag->count[order]++] = fill[i];
+	mag->refills++;
 
-	if (range_overflows(start, size, mm->size))
-		return -EINVAL;
+	for (; i < n; i++)
+		__drm_buddy_free(mm, fill[i]);
 
-	/* Actual range allocation */
-	if (start + size == end)
-		return __drm_buddy_alloc_range(mm, start, size, blocks);
+	return block;
+}
 
-	if (!IS_ALIGNED(size, min_page_size))
-		return -EINVAL;
+static bool cache_alloc_blocks(struct drm_buddy *mm, u64 size,
+			       struct list_head *blocks,
+			       unsigned long flags)
+{
+	struct drm_buddy_block *block;
+	unsigned int order;
+
+	if (!mm->cache ||
+	    flags & (DRM_BUDDY_RANGE_ALLOCATION | DRM_BUDDY_TOPDOWN_ALLOCATION) ||
+	    !is_power_of_2(size))
+		return false;
+
+	order = ilog2(size) - ilog2(mm->chunk_size);
+	if (order >= DRM_BUDDY_CACHE_ORDERS)
+		return false;
+
+	block = cache_get(mm, order);
+	if (!block)
+		block = cache_refill(mm, order);
+	if (!block)
+		return false;
+
+	mm->avail -= drm_buddy_block_size(mm, block);
+#ifdef __FreeBSD__
+	trace_drm_alloc(DRM_ALLOC_TRACE_BUDDY, mm,
+			drm_buddy_block_offset(block),
+			drm_buddy_block_size(mm, block), 0);
+#endif
+	list_add_tail(&block->link, blocks);
+
+	return true;
+}
+
+static int __drm_buddy_alloc_blocks(struct drm_buddy *mm,
+				    u64 start, u64 end, u64 size,
+				    u64 min_page_size,
+				    struct list_head *blocks,
+				    unsigned long flags)
+{
+	struct drm_buddy_block *block = NULL;
+	unsigned int min_order, order;
+	unsigned long pages;
+	LIST_HEAD(allocated);
+	int err;
 
 	pages = size >> ilog2(mm->chunk_size);
 	order = fls(pages) - 1;
@@ -721,9 +913,14 @@ int drm_buddy_alloc_blocks(struct drm_buddy *mm,
 			}
 		} while (1);
 
-		mark_allocated(block);
+		mark_allocated(mm, block);
 		mm->avail -= drm_buddy_block_size(mm, block);
 		kmemleak_update_trace(block);
+#ifdef __FreeBSD__
+		trace_drm_alloc(DRM_ALLOC_TRACE_BUDDY, mm,
+				drm_buddy_block_offset(block),
+				drm_buddy_block_size(mm, block), min_page_size);
+#endif
 		list_add_tail(&block->link, &allocated);
 
 		pages -= BIT(order);
@@ -739,6 +936,86 @@ err_free:
 	drm_buddy_free_list(mm, &allocated);
 	return err;
 }
+
+/**
+ * drm_buddy_alloc_blocks - allocate power-of-two blocks
+ *
+ * @mm: DRM buddy manager to allocate from
+ * @start: start of the allowed range for this block
+ * @end: end of the allowed range for this block
+ * @size: size of the allocation
+ * @min_page_size: alignment of the allocation
+ * @blocks: output list head to add allocated blocks
+ * @flags: DRM_BUDDY_*_ALLOCATION flags
+ *
+ * alloc_range_bias() called on range limitations, which traverses
+ * the tree and returns the desired block.
+ *
+ * alloc_from_freelist() called when *no* range restrictions
+ * are enforced, which picks the block from the freelist.
+ *
+ * Returns:
+ * 0 on success, error code on failure.
+ */
+int drm_buddy_alloc_blocks(struct drm_buddy *mm,
+			   u64 start, u64 end, u64 size,
+			   u64 min_page_size,
+			   struct list_head *blocks,
+			   unsigned long flags)
+{
+	bool drained = false;
+	int err;
+
+	if (size < mm->chunk_size)
+		return -EINVAL;
+
+	if (min_page_size < mm->chunk_size)
+		return -EINVAL;
+
+	if (!is_power_of_2(min_page_size))
+		return -EINVAL;
+
+	if (!IS_ALIGNED(start | end | size, mm->chunk_size))
+		return -EINVAL;
+
+	if (end > mm->size)
+		return -EINVAL;
+
+	if (range_overflows(start, size, mm->size))
+		return -EINVAL;
+
+	if (start + size != end && !IS_ALIGNED(size, min_page_size))
+		return -EINVAL;
+
+again:
+	/* Actual range allocation */
+	if (start + size == end) {
+		err = __drm_buddy_alloc_range(mm, start, size, blocks);
+	} else if (cache_alloc_blocks(mm, size, blocks, flags)) {
+		err = 0;
+	} else {
+		/*
+		 * Cached blocks pin their buddies, so merge them back first if
+		 * the largest block of this allocation isn't free anywhere.
+		 */
+		if (!drained &&
+		    !has_free_order(mm, ilog2(size) - ilog2(mm->chunk_size))) {
+			drained = true;
+			cache_drain(mm);
+		}
+		err = __drm_buddy_alloc_blocks(mm, start, end, size,
+					       min_page_size, blocks, flags);
+	}
+
+	/* Give the cached blocks back to the tree before failing. */
+	if (err == -ENOSPC && !drained) {
+		drained = true;
+		if (cache_drain(mm))
+			goto again;
+	}
+
+	return err;
+}
 EXPORT_SYMBOL(drm_buddy_alloc_blocks);
 
 /**
@@ -773,10 +1050,11 @@ void drm_buddy_print(struct drm_buddy *mm, struct drm_printer *p)
 		   mm->chunk_size >> 10, mm->size >> 20, mm->avail >> 20);
 
 	for (order = mm->max_order; order >= 0; order--) {
-		struct drm_buddy_block *block;
+		struct drm_buddy_block *block, *on;
 		u64 count = 0, free;
 
-		list_for_each_entry(block, &mm->free_list[order], link) {
+		rbtree_postorder_for_each_entry_safe(block, on,
+				&mm->free_tree[order].rb_root, rb) {
 			BUG_ON(!drm_buddy_block_is_free(block));
 			count++;
 		}
@@ -791,6 +1069,19 @@ void drm_buddy_print(struct drm_buddy *mm, struct drm_printer *p)
 
 		drm_printf(p, ", blocks: %llu\n", count);
 	}
+
+	if (mm->cache) {
+		struct drm_buddy_magazine *mag = mm->cache;
+		u64 cached = 0;
+
+		for (order = 0; order < DRM_BUDDY_CACHE_ORDERS; order++)
+			cached += (u64)mag->count[order] *
+				  (mm->chunk_size << order);
+
+		drm_printf(p, "cache: %llu KiB, hits: %llu, misses: %llu, refills: %llu, drains: %llu\n",
+			   cached >> 10, mag->hits, mag->misses, mag->refills,
+			   mag->drains);
+	}
 }
 EXPORT_SYMBOL(drm_buddy_print);
 
@@ -288,6 +288,37 @@ static void __memcpy_ntdqa(void *dst, const void *src, unsigned long len)
 	kernel_fpu_end();
 }
 
+/* Same as __memcpy_ntdqa, but the stores bypass the cache as well */
+static void __memcpy_ntdqa_nt(void *dst, const void *src, unsigned long len)
+{
+	kernel_fpu_begin();
+
+	while (len >= 4) {
+		asm("movntdqa	(%0), %%xmm0\n"
+		    "movntdqa 16(%0), %%xmm1\n"
+		    "movntdqa 32(%0), %%xmm2\n"
+		    "movntdqa 48(%0), %%xmm3\n"
+		    "movntdq %%xmm0,   (%1)\n"
+		    "movntdq %%xmm1, 16(%1)\n"
+		    "movntdq %%xmm2, 32(%1)\n"
+		    "movntdq %%xmm3, 48(%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 64;
+		dst += 64;
+		len -= 4;
+	}
+	while (len--) {
+		asm("movntdqa (%0), %%xmm0\n"
+		    "movntdq %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst) : "memory");
+		src += 16;
+		dst += 16;
+	}
+	asm volatile("sfence" ::: "memory");
+
+	kernel_fpu_end();
+}
+
 /*
  * __drm_memcpy_from_wc copies @len bytes from @src to @dst using
  * non-temporal instructions where available. Note that all arguments
@@ -336,6 +367,42 @@ void drm_memcpy_from_wc(struct iosys_map *dst,
 }
 EXPORT_SYMBOL(drm_memcpy_from_wc);
 
+/**
+ * drm_memcpy_from_wc_streaming - Perform a bulk memcpy from a source that
+ * may be WC.
+ * @dst: The destination pointer
+ * @src: The source pointer
+ * @len: The size of the area o transfer in bytes
+ *
+ * Like drm_memcpy_from_wc(), but also uses non-temporal stores, so that
+ * moving large buffers doesn't flush the CPU caches. Meant for copies of
+ * many pages which the CPU doesn't read back right away, like buffer moves.
+ * The whole copy runs in one FPU section with preemption disabled, so
+ * callers should keep @len down to a few pages.
+ */
+void drm_memcpy_from_wc_streaming(struct iosys_map *dst,
+				  const struct iosys_map *src,
+				  unsigned long len)
+{
+	void *d = dst->is_iomem ? (void __force *)dst->vaddr_iomem : dst->vaddr;
+	const void *s = src->is_iomem ?
+		(const void __force *)src->vaddr_iomem : src->vaddr;
+
+	if (WARN_ON(in_interrupt())) {
+		memcpy_fallback(dst, src, len);
+		return;
+	}
+
+	if (static_branch_likely(&has_movntdqa) &&
+	    !(((unsigned long)d | (unsigned long)s | len) & 15)) {
+		__memcpy_ntdqa_nt(d, s, len >> 4);
+		return;
+	}
+
+	drm_memcpy_from_wc(dst, src, len);
+}
+EXPORT_SYMBOL(drm_memcpy_from_wc_streaming);
+
 /*
  * drm_memcpy_init_early - One time initialization of the WC memcpy code
  */
@@ -360,6 +427,14 @@ void drm_memcpy_from_wc(struct iosys_map *dst,
 }
 EXPORT_SYMBOL(drm_memcpy_from_wc);
 
+void drm_memcpy_from_wc_streaming(struct iosys_map *dst,
+				  const struct iosys_map *src,
+				  unsigned long len)
+{
+	drm_memcpy_from_wc(dst, src, len);
+}
+EXPORT_SYMBOL(drm_memcpy_from_wc_streaming);
+
 void drm_memcpy_init_early(void)
 {
 }
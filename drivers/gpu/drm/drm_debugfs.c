@@ -40,10 +40,12 @@
 #include <drm/drm_file.h>
 #include <drm/drm_gem.h>
 #include <drm/drm_managed.h>
+#include <drm/drm_print.h>
 #include <drm/drm_gpuva_mgr.h>
 
 #include "drm_crtc_internal.h"
 #include "drm_internal.h"
+#include "drm_legacy.h"
 
 #if defined(CONFIG_DEBUG_FS)
 
@@ -148,10 +150,78 @@ static int drm_gem_name_info(struct seq_file *m, void *data)
 	return 0;
 }
 
+#ifdef __FreeBSD__
+static int drm_ioctl_stats_info(struct seq_file *m, void *data)
+{
+	struct drm_debugfs_entry *entry = m->private;
+	struct drm_device *dev = entry->dev;
+	struct drm_stats *stats = dev->stats;
+	uint64_t hist[DRM_IOCTL_HIST_BUCKETS];
+	struct drm_ioctl_stats *is;
+	unsigned int i, b;
+	uint64_t count;
+
+	seq_printf(m, "histograms %s\n",
+		   atomic_load_acq_int(&stats->ioctl_hist) ? "on" : "off");
+
+	mutex_lock(&stats->ioctl_lock);
+	for (i = 0; i < stats->num_ioctls; i++) {
+		is = &stats->ioctls[i];
+		if (is->count == NULL)
+			continue;
+		count = counter_u64_fetch(is->count);
+		if (count == 0)
+			continue;
+
+		seq_printf(m, "%-40s %10ju calls %12ju ns avg\n",
+			   drm_ioctl_stats_desc(dev, i)->name, (uintmax_t)count,
+			   (uintmax_t)(counter_u64_fetch(is->time_ns) / count));
+		if (is->hist == NULL)
+			continue;
+
+		COUNTER_ARRAY_COPY(is->hist, hist, DRM_IOCTL_HIST_BUCKETS);
+		for (b = 0; b < DRM_IOCTL_HIST_BUCKETS - 1; b++) {
+			if (hist[b])
+				seq_printf(m, "\t< %10ju ns %10ju\n",
+					   (uintmax_t)1 << (b + DRM_IOCTL_HIST_SHIFT),
+					   (uintmax_t)hist[b]);
+		}
+		if (hist[b])
+			seq_printf(m, "\t>= %9ju ns %10ju\n",
+				   (uintmax_t)1 << (b + DRM_IOCTL_HIST_SHIFT - 1),
+				   (uintmax_t)hist[b]);
+	}
+	mutex_unlock(&stats->ioctl_lock);
+
+	return 0;
+}
+#endif
+
+#if IS_ENABLED(CONFIG_DRM_LEGACY)
+static int drm_map_hash_info(struct seq_file *m, void *data)
+{
+	struct drm_debugfs_entry *entry = m->private;
+	struct drm_device *dev = entry->dev;
+	struct drm_printer p = drm_seq_file_printer(m);
+
+	mutex_lock(&dev->struct_mutex);
+	drm_ht_print_stats(&dev->map_hash, &p);
+	mutex_unlock(&dev->struct_mutex);
+
+	return 0;
+}
+#endif
+
 static const struct drm_debugfs_info drm_debugfs_list[] = {
 	{"name", drm_name_info, 0},
 	{"clients", drm_clients_info, 0},
 	{"gem_names", drm_gem_name_info, DRIVER_GEM},
+#if IS_ENABLED(CONFIG_DRM_LEGACY)
+	{"map_hash", drm_map_hash_info, DRIVER_LEGACY},
+#endif
+#ifdef __FreeBSD__
+	{"ioctl_stats", drm_ioctl_stats_info, 0},
+#endif
 };
 #define DRM_DEBUGFS_ENTRIES ARRAY_SIZE(drm_debugfs_list)
 
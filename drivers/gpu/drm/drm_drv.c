@@ -41,6 +41,7 @@
 #include <drm/drm_color_mgmt.h>
 #include <drm/drm_drv.h>
 #include <drm/drm_file.h>
+#include <drm/drm_format_helper.h>
 #include <drm/drm_managed.h>
 #include <drm/drm_mode_object.h>
 #include <drm/drm_print.h>
@@ -49,6 +50,9 @@
 #include "drm_crtc_internal.h"
 #include "drm_internal.h"
 #include "drm_legacy.h"
+#ifdef __FreeBSD__
+#include "drm_trace_freebsd.h"
+#endif
 
 MODULE_AUTHOR("Gareth Hughes, Leif Delgass, José Fonseca, Jon Smirl");
 MODULE_DESCRIPTION("DRM shared core routines");
@@ -693,6 +697,12 @@ static int drm_dev_init(struct drm_device *dev,
 
 	drm_legacy_ctxbitmap_init(dev);
 
+#ifdef __FreeBSD__
+	ret = drm_stats_init(dev);
+	if (ret)
+		goto err;
+#endif
+
 	if (drm_core_check_feature(dev, DRIVER_GEM)) {
 		ret = drm_gem_init(dev);
 		if (ret) {
@@ -953,6 +963,10 @@ int drm_dev_register(struct drm_device *dev, unsigned long flags)
 	if (drm_core_check_feature(dev, DRIVER_MODESET))
 		drm_modeset_register_all(dev);
 
+#ifdef __FreeBSD__
+	drm_sysctl_stats_driver_init(dev);
+#endif
+
 	DRM_INFO("Initialized %s %d.%d.%d %s for %s on minor %d\n",
 		 driver->name, driver->major, driver->minor,
 		 driver->patchlevel, driver->date,
@@ -1077,6 +1091,9 @@ static void drm_core_exit(void)
 	unregister_chrdev(DRM_MAJOR, "drm");
 #ifdef CONFIG_DEBUG_FS
 	debugfs_remove(drm_debugfs_root);
+#endif
+#ifdef __FreeBSD__
+	drm_alloc_trace_fini();
 #endif
 	drm_sysfs_destroy();
 	idr_destroy(&drm_minors_idr);
@@ -1090,6 +1107,9 @@ static int __init drm_core_init(void)
 	drm_connector_ida_init();
 	idr_init(&drm_minors_idr);
 	drm_memcpy_init_early();
+#ifdef __FreeBSD__
+	drm_format_helper_init_early();
+#endif
 
 	ret = drm_sysfs_init();
 	if (ret < 0) {
@@ -1099,6 +1119,9 @@ static int __init drm_core_init(void)
 
 #ifdef CONFIG_DEBUG_FS
 	drm_debugfs_root = debugfs_create_dir("dri", NULL);
+#ifdef __FreeBSD__
+	drm_alloc_trace_debugfs_init(drm_debugfs_root);
+#endif
 #endif
 
 #ifdef __linux__
@@ -20,11 +20,344 @@
 #include <drm/drm_print.h>
 #include <drm/drm_rect.h>
 
+#if defined(__FreeBSD__) && defined(CONFIG_X86)
+#include <machine/md_var.h>
+#include <machine/specialreg.h>
+
+#include <asm/fpu/api.h>
+#include <linux/jump_label.h>
+#endif
+
 static unsigned int clip_offset(const struct drm_rect *clip, unsigned int pitch, unsigned int cpp)
 {
 	return clip->y1 * pitch + clip->x1 * cpp;
 }
 
+#ifdef __FreeBSD__
+/*
+ * SIMD versions of the most used XRGB8888 line converters. Each one
+ * converts the bulk of a line and returns the number of pixels it did;
+ * the scalar *_line() helper finishes the remainder and stays the
+ * reference implementation. The kernel is built without SIMD code
+ * generation, so like drm_cache.c this is inline assembly between
+ * kernel_fpu_begin() and kernel_fpu_end().
+ */
+#ifdef CONFIG_X86
+
+static DEFINE_STATIC_KEY_FALSE(has_sse2);
+static DEFINE_STATIC_KEY_FALSE(has_ssse3);
+
+/* Below this many pixels saving the FPU state costs more than it gains. */
+#define DRM_FB_SIMD_MIN_PIXELS	32
+
+static bool drm_fb_simd_usable(unsigned int pixels)
+{
+	if (pixels < DRM_FB_SIMD_MIN_PIXELS)
+		return false;
+
+	/* fpu_kern_enter() is off limits in interrupts and the debugger. */
+	return !in_interrupt() && !kdb_active && !KERNEL_PANICKED();
+}
+
+static const u32 drm_fb_rgb565_mask[3][4] __aligned(16) = {
+	{ 0x0000f800, 0x0000f800, 0x0000f800, 0x0000f800 },
+	{ 0x000007e0, 0x000007e0, 0x000007e0, 0x000007e0 },
+	{ 0x0000001f, 0x0000001f, 0x0000001f, 0x0000001f },
+};
+
+static unsigned int drm_fb_xrgb8888_to_rgb565_sse2(void *dbuf, const void *sbuf,
+						   unsigned int pixels)
+{
+	const u8 *src = sbuf;
+	u8 *dst = dbuf;
+	unsigned int x;
+
+	kernel_fpu_begin();
+	for (x = 0; x + 8 <= pixels; x += 8) {
+		asm("movdqu   (%0), %%xmm0\n"
+		    "movdqu 16(%0), %%xmm1\n"
+		    "movdqa %%xmm0, %%xmm2\n"
+		    "movdqa %%xmm0, %%xmm3\n"
+		    "movdqa %%xmm1, %%xmm4\n"
+		    "movdqa %%xmm1, %%xmm5\n"
+		    "psrld $8, %%xmm2\n"
+		    "psrld $5, %%xmm3\n"
+		    "psrld $3, %%xmm0\n"
+		    "psrld $8, %%xmm4\n"
+		    "psrld $5, %%xmm5\n"
+		    "psrld $3, %%xmm1\n"
+		    "pand   (%2), %%xmm2\n"
+		    "pand 16(%2), %%xmm3\n"
+		    "pand 32(%2), %%xmm0\n"
+		    "pand   (%2), %%xmm4\n"
+		    "pand 16(%2), %%xmm5\n"
+		    "pand 32(%2), %%xmm1\n"
+		    "por %%xmm2, %%xmm0\n"
+		    "por %%xmm3, %%xmm0\n"
+		    "por %%xmm4, %%xmm1\n"
+		    "por %%xmm5, %%xmm1\n"
+		    /* sign-extend the low halves so packssdw cannot saturate */
+		    "pslld $16, %%xmm0\n"
+		    "pslld $16, %%xmm1\n"
+		    "psrad $16, %%xmm0\n"
+		    "psrad $16, %%xmm1\n"
+		    "packssdw %%xmm1, %%xmm0\n"
+		    "movdqu %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst), "r" (drm_fb_rgb565_mask) : "memory");
+		src += 32;
+		dst += 16;
+	}
+	kernel_fpu_end();
+
+	return x;
+}
+
+/* Drop the X byte of every pixel, packing four BGR triplets into 12 bytes. */
+static const u8 drm_fb_rgb888_shuffle[16] __aligned(16) = {
+	0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, 0x80, 0x80, 0x80, 0x80,
+};
+
+static unsigned int drm_fb_xrgb8888_to_rgb888_ssse3(void *dbuf, const void *sbuf,
+						    unsigned int pixels)
+{
+	const u8 *src = sbuf;
+	u8 *dst = dbuf;
+	unsigned int x;
+
+	kernel_fpu_begin();
+	for (x = 0; x + 16 <= pixels; x += 16) {
+		asm("movdqa (%2), %%xmm7\n"
+		    "movdqu   (%0), %%xmm0\n"
+		    "movdqu 16(%0), %%xmm1\n"
+		    "movdqu 32(%0), %%xmm2\n"
+		    "movdqu 48(%0), %%xmm3\n"
+		    "pshufb %%xmm7, %%xmm0\n"
+		    "pshufb %%xmm7, %%xmm1\n"
+		    "pshufb %%xmm7, %%xmm2\n"
+		    "pshufb %%xmm7, %%xmm3\n"
+		    /* 3 x 16 bytes out of 4 x 12 bytes */
+		    "movdqa %%xmm1, %%xmm4\n"
+		    "pslldq $12, %%xmm4\n"
+		    "por %%xmm4, %%xmm0\n"
+		    "psrldq $4, %%xmm1\n"
+		    "movdqa %%xmm2, %%xmm5\n"
+		    "pslldq $8, %%xmm5\n"
+		    "por %%xmm5, %%xmm1\n"
+		    "psrldq $8, %%xmm2\n"
+		    "pslldq $4, %%xmm3\n"
+		    "por %%xmm3, %%xmm2\n"
+		    "movdqu %%xmm0,   (%1)\n"
+		    "movdqu %%xmm1, 16(%1)\n"
+		    "movdqu %%xmm2, 32(%1)\n"
+		    :: "r" (src), "r" (dst), "r" (drm_fb_rgb888_shuffle) : "memory");
+		src += 64;
+		dst += 48;
+	}
+	kernel_fpu_end();
+
+	return x;
+}
+
+static const u32 drm_fb_xrgb2101010_mask[4][4] __aligned(16) = {
+	{ 0x000000ff, 0x000000ff, 0x000000ff, 0x000000ff },
+	{ 0x0000ff00, 0x0000ff00, 0x0000ff00, 0x0000ff00 },
+	{ 0x00ff0000, 0x00ff0000, 0x00ff0000, 0x00ff0000 },
+	{ 0x00300c03, 0x00300c03, 0x00300c03, 0x00300c03 },
+};
+
+static unsigned int drm_fb_xrgb8888_to_xrgb2101010_sse2(void *dbuf, const void *sbuf,
+							unsigned int pixels)
+{
+	const u8 *src = sbuf;
+	u8 *dst = dbuf;
+	unsigned int x;
+
+	kernel_fpu_begin();
+	for (x = 0; x + 4 <= pixels; x += 4) {
+		asm("movdqu (%0), %%xmm0\n"
+		    "movdqa %%xmm0, %%xmm1\n"
+		    "movdqa %%xmm0, %%xmm2\n"
+		    "pand   (%2), %%xmm0\n"
+		    "pand 16(%2), %%xmm1\n"
+		    "pand 32(%2), %%xmm2\n"
+		    "pslld $2, %%xmm0\n"
+		    "pslld $4, %%xmm1\n"
+		    "pslld $6, %%xmm2\n"
+		    "por %%xmm1, %%xmm0\n"
+		    "por %%xmm2, %%xmm0\n"
+		    /* replicate the top two bits of each channel into the bottom */
+		    "movdqa %%xmm0, %%xmm1\n"
+		    "psrld $8, %%xmm1\n"
+		    "pand 48(%2), %%xmm1\n"
+		    "por %%xmm1, %%xmm0\n"
+		    "movdqu %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst), "r" (drm_fb_xrgb2101010_mask) : "memory");
+		src += 16;
+		dst += 16;
+	}
+	kernel_fpu_end();
+
+	return x;
+}
+
+/*
+ * pmaddwd weights for the B, G, R, X words of a pixel, then for summing
+ * the two partial products. The division by 10 is a multiply by
+ * 0xcccd >> 19, which is exact for the 0..2550 range of 3R + 6G + B.
+ */
+static const u16 drm_fb_gray8_coef[3][8] __aligned(16) = {
+	{ 1, 6, 3, 0, 1, 6, 3, 0 },
+	{ 1, 1, 1, 1, 1, 1, 1, 1 },
+	{ 0xcccd, 0xcccd, 0xcccd, 0xcccd, 0xcccd, 0xcccd, 0xcccd, 0xcccd },
+};
+
+static unsigned int drm_fb_xrgb8888_to_gray8_sse2(void *dbuf, const void *sbuf,
+						  unsigned int pixels)
+{
+	const u8 *src = sbuf;
+	u8 *dst = dbuf;
+	unsigned int x;
+
+	kernel_fpu_begin();
+	for (x = 0; x + 16 <= pixels; x += 16) {
+		asm("pxor %%xmm7, %%xmm7\n"
+		    "movdqu   (%0), %%xmm0\n"
+		    "movdqu 16(%0), %%xmm2\n"
+		    "movdqu 32(%0), %%xmm4\n"
+		    "movdqu 48(%0), %%xmm6\n"
+		    "movdqa %%xmm0, %%xmm1\n"
+		    "movdqa %%xmm2, %%xmm3\n"
+		    "movdqa %%xmm4, %%xmm5\n"
+		    "punpcklbw %%xmm7, %%xmm0\n"
+		    "punpckhbw %%xmm7, %%xmm1\n"
+		    "punpcklbw %%xmm7, %%xmm2\n"
+		    "punpckhbw %%xmm7, %%xmm3\n"
+		    "punpcklbw %%xmm7, %%xmm4\n"
+		    "punpckhbw %%xmm7, %%xmm5\n"
+		    "pmaddwd (%2), %%xmm0\n"
+		    "pmaddwd (%2), %%xmm1\n"
+		    "pmaddwd (%2), %%xmm2\n"
+		    "pmaddwd (%2), %%xmm3\n"
+		    "pmaddwd (%2), %%xmm4\n"
+		    "pmaddwd (%2), %%xmm5\n"
+		    "packssdw %%xmm1, %%xmm0\n"
+		    "packssdw %%xmm3, %%xmm2\n"
+		    "packssdw %%xmm5, %%xmm4\n"
+		    "pmaddwd 16(%2), %%xmm0\n"
+		    "pmaddwd 16(%2), %%xmm2\n"
+		    "pmaddwd 16(%2), %%xmm4\n"
+		    "packssdw %%xmm2, %%xmm0\n"
+		    /* last four pixels, reusing xmm1-xmm3 */
+		    "movdqa %%xmm6, %%xmm1\n"
+		    "punpcklbw %%xmm7, %%xmm6\n"
+		    "punpckhbw %%xmm7, %%xmm1\n"
+		    "pmaddwd (%2), %%xmm6\n"
+		    "pmaddwd (%2), %%xmm1\n"
+		    "packssdw %%xmm1, %%xmm6\n"
+		    "pmaddwd 16(%2), %%xmm6\n"
+		    "packssdw %%xmm6, %%xmm4\n"
+		    /* divide by 10 and narrow to bytes */
+		    "pmulhuw 32(%2), %%xmm0\n"
+		    "pmulhuw 32(%2), %%xmm4\n"
+		    "psrlw $3, %%xmm0\n"
+		    "psrlw $3, %%xmm4\n"
+		    "packuswb %%xmm4, %%xmm0\n"
+		    "movdqu %%xmm0, (%1)\n"
+		    :: "r" (src), "r" (dst), "r" (drm_fb_gray8_coef) : "memory");
+		src += 64;
+		dst += 16;
+	}
+	kernel_fpu_end();
+
+	return x;
+}
+
+static unsigned int drm_fb_gray8_to_mono_sse2(void *dbuf, const void *sbuf,
+					      unsigned int pixels)
+{
+	const u8 *src = sbuf;
+	u8 *dst = dbuf;
+	unsigned int x, mask;
+
+	kernel_fpu_begin();
+	for (x = 0; x + 16 <= pixels; x += 16) {
+		/* the MSB of each byte is exactly the >= 128 test */
+		asm("movdqu (%1), %%xmm0\n"
+		    "pmovmskb %%xmm0, %0\n"
+		    : "=r" (mask) : "r" (src) : "memory");
+		dst[0] = mask;
+		dst[1] = mask >> 8;
+		src += 16;
+		dst += 2;
+	}
+	kernel_fpu_end();
+
+	return x;
+}
+
+static unsigned int drm_fb_xrgb8888_to_rgb565_simd(void *dbuf, const void *sbuf,
+						   unsigned int pixels)
+{
+	if (static_branch_likely(&has_sse2) && drm_fb_simd_usable(pixels))
+		return drm_fb_xrgb8888_to_rgb565_sse2(dbuf, sbuf, pixels);
+	return 0;
+}
+
+static unsigned int drm_fb_xrgb8888_to_rgb888_simd(void *dbuf, const void *sbuf,
+						   unsigned int pixels)
+{
+	if (static_branch_likely(&has_ssse3) && drm_fb_simd_usable(pixels))
+		return drm_fb_xrgb8888_to_rgb888_ssse3(dbuf, sbuf, pixels);
+	return 0;
+}
+
+static unsigned int drm_fb_xrgb8888_to_xrgb2101010_simd(void *dbuf, const void *sbuf,
+							unsigned int pixels)
+{
+	if (static_branch_likely(&has_sse2) && drm_fb_simd_usable(pixels))
+		return drm_fb_xrgb8888_to_xrgb2101010_sse2(dbuf, sbuf, pixels);
+	return 0;
+}
+
+static unsigned int drm_fb_xrgb8888_to_gray8_simd(void *dbuf, const void *sbuf,
+						  unsigned int pixels)
+{
+	if (static_branch_likely(&has_sse2) && drm_fb_simd_usable(pixels))
+		return drm_fb_xrgb8888_to_gray8_sse2(dbuf, sbuf, pixels);
+	return 0;
+}
+
+static unsigned int drm_fb_gray8_to_mono_simd(void *dbuf, const void *sbuf,
+					      unsigned int pixels)
+{
+	if (static_branch_likely(&has_sse2) && drm_fb_simd_usable(pixels))
+		return drm_fb_gray8_to_mono_sse2(dbuf, sbuf, pixels);
+	return 0;
+}
+
+/*
+ * drm_format_helper_init_early - Select the SIMD line converters
+ */
+void drm_format_helper_init_early(void)
+{
+	if (cpu_feature & CPUID_SSE2)
+		static_branch_enable(&has_sse2);
+	if (cpu_feature2 & CPUID2_SSSE3)
+		static_branch_enable(&has_ssse3);
+}
+#else
+#define drm_fb_xrgb8888_to_rgb565_simd(dbuf, sbuf, pixels)	0U
+#define drm_fb_xrgb8888_to_rgb888_simd(dbuf, sbuf, pixels)	0U
+#define drm_fb_xrgb8888_to_xrgb2101010_simd(dbuf, sbuf, pixels)	0U
+#define drm_fb_xrgb8888_to_gray8_simd(dbuf, sbuf, pixels)	0U
+#define drm_fb_gray8_to_mono_simd(dbuf, sbuf, pixels)		0U
+
+void drm_format_helper_init_early(void)
+{
+}
+#endif /* CONFIG_X86 */
+#endif /* __FreeBSD__ */
+
 /**
  * drm_fb_clip_offset - Returns the clipping rectangles byte-offset in a framebuffer
  * @pitch: Framebuffer line pitch in byte
@@ -328,7 +661,11 @@ static void drm_fb_xrgb8888_to_rgb565_line(void *dbuf, const void *sbuf, unsigne
 	u16 val16;
 	u32 pix;
 
+#ifdef __linux__
 	for (x = 0; x < pixels; x++) {
+#elif defined(__FreeBSD__)
+	for (x = drm_fb_xrgb8888_to_rgb565_simd(dbuf, sbuf, pixels); x < pixels; x++) {
+#endif
 		pix = le32_to_cpu(sbuf32[x]);
 		val16 = ((pix & 0x00F80000) >> 8) |
 			((pix & 0x0000FC00) >> 5) |
@@ -558,7 +895,12 @@ static void drm_fb_xrgb8888_to_rgb888_line(void *dbuf, const void *sbuf, unsigne
 	unsigned int x;
 	u32 pix;
 
+#ifdef __linux__
 	for (x = 0; x < pixels; x++) {
+#elif defined(__FreeBSD__)
+	x = drm_fb_xrgb8888_to_rgb888_simd(dbuf, sbuf, pixels);
+	for (dbuf8 += x * 3; x < pixels; x++) {
+#endif
 		pix = le32_to_cpu(sbuf32[x]);
 		/* write blue-green-red to output in little endianness */
 		*dbuf8++ = (pix & 0x000000FF) >>  0;
@@ -717,7 +1059,12 @@ static void drm_fb_xrgb8888_to_xrgb2101010_line(void *dbuf, const void *sbuf, un
 	u32 val32;
 	u32 pix;
 
+#ifdef __linux__
 	for (x = 0; x < pixels; x++) {
+#elif defined(__FreeBSD__)
+	x = drm_fb_xrgb8888_to_xrgb2101010_simd(dbuf, sbuf, pixels);
+	for (dbuf32 += x; x < pixels; x++) {
+#endif
 		pix = le32_to_cpu(sbuf32[x]);
 		val32 = ((pix & 0x000000FF) << 2) |
 			((pix & 0x0000FF00) << 4) |
@@ -820,7 +1167,12 @@ static void drm_fb_xrgb8888_to_gray8_line(void *dbuf, const void *sbuf, unsigned
 	const __le32 *sbuf32 = sbuf;
 	unsigned int x;
 
+#ifdef __linux__
 	for (x = 0; x < pixels; x++) {
+#elif defined(__FreeBSD__)
+	x = drm_fb_xrgb8888_to_gray8_simd(dbuf, sbuf, pixels);
+	for (dbuf8 += x; x < pixels; x++) {
+#endif
 		u32 pix = le32_to_cpu(sbuf32[x]);
 		u8 r = (pix & 0x00ff0000) >> 16;
 		u8 g = (pix & 0x0000ff00) >> 8;
@@ -957,6 +1309,13 @@ static void drm_fb_gray8_to_mono_line(void *dbuf, const void *sbuf, unsigned int
 {
 	u8 *dbuf8 = dbuf;
 	const u8 *sbuf8 = sbuf;
+#ifdef __FreeBSD__
+	unsigned int done = drm_fb_gray8_to_mono_simd(dbuf, sbuf, pixels);
+
+	dbuf8 += done / 8;
+	sbuf8 += done;
+	pixels -= done;
+#endif
 
 	while (pixels) {
 		unsigned int i, bits = min(pixels, 8U);
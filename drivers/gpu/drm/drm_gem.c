@@ -173,6 +173,9 @@ void drm_gem_private_object_init(struct drm_device *dev,
 
 	drm_vma_node_reset(&obj->vma_node);
 	INIT_LIST_HEAD(&obj->lru_node);
+#ifdef __FreeBSD__
+	drm_stats_gem(dev, 1, size);
+#endif
 }
 EXPORT_SYMBOL(drm_gem_private_object_init);
 
@@ -187,6 +190,9 @@ void drm_gem_private_object_fini(struct drm_gem_object *obj)
 	WARN_ON(obj->dma_buf);
 
 	dma_resv_fini(&obj->_resv);
+#ifdef __FreeBSD__
+	drm_stats_gem(obj->dev, -1, -(int64_t)obj->size);
+#endif
 }
 EXPORT_SYMBOL(drm_gem_private_object_fini);
 
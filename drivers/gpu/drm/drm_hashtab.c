@@ -42,33 +42,81 @@
 
 #include "drm_legacy.h"
 
+/*
+ * The bucket array doubles once the table holds more than
+ * DRM_HT_MAX_LOAD items per bucket on average, up to DRM_HT_MAX_ORDER.
+ * Entries are moved to the new array inside a resize_seq write section, so
+ * an RCU lookup that misses while a resize was in progress simply retries.
+ * The old array is freed after a grace period.
+ *
+ * Inserts are traditionally done under a spinlock, so the new array is
+ * allocated without sleeping. If that fails the table keeps its size and
+ * growing is retried once the load went up by another item per bucket.
+ */
+#define DRM_HT_MAX_LOAD		2
+#define DRM_HT_MAX_ORDER	20
+#define DRM_HT_STATS_CHAINS	8
+
+struct drm_ht_table {
+	struct rcu_head rcu;
+	unsigned int order;
+	struct hlist_head buckets[];
+};
+
+static struct drm_ht_table *drm_ht_table_alloc(unsigned int order, gfp_t gfp)
+{
+	struct drm_ht_table *tbl;
+
+	tbl = kvzalloc(struct_size(tbl, buckets, 1UL << order), gfp);
+	if (tbl)
+		tbl->order = order;
+	return tbl;
+}
+
+static void drm_ht_table_free_rcu(struct rcu_head *rcu)
+{
+	kvfree(container_of(rcu, struct drm_ht_table, rcu));
+}
+
+static inline struct drm_ht_table *drm_ht_get_table(struct drm_open_hash *ht)
+{
+	return rcu_dereference_protected(ht->table, true);
+}
+
+static inline struct hlist_head *drm_ht_bucket(struct drm_ht_table *tbl,
+					       unsigned long key)
+{
+	return &tbl->buckets[hash_long(key, tbl->order)];
+}
+
 int drm_ht_create(struct drm_open_hash *ht, unsigned int order)
 {
-	unsigned int size = 1 << order;
+	struct drm_ht_table *tbl;
 
 	ht->order = order;
-	ht->table = NULL;
-	if (size <= PAGE_SIZE / sizeof(*ht->table))
-		ht->table = kcalloc(size, sizeof(*ht->table), GFP_KERNEL);
-	else
-		ht->table = vzalloc(array_size(size, sizeof(*ht->table)));
-	if (!ht->table) {
+	ht->count = 0;
+	ht->resizes = 0;
+	seqcount_init(&ht->resize_seq);
+	tbl = drm_ht_table_alloc(order, GFP_KERNEL);
+	if (!tbl) {
 		DRM_ERROR("Out of memory for hash table\n");
 		return -ENOMEM;
 	}
+	RCU_INIT_POINTER(ht->table, tbl);
 	return 0;
 }
 
 void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key)
 {
+	struct drm_ht_table *tbl = drm_ht_get_table(ht);
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
 	unsigned int hashed_key;
 	int count = 0;
 
-	hashed_key = hash_long(key, ht->order);
+	hashed_key = hash_long(key, tbl->order);
 	DRM_DEBUG("Key is 0x%08lx, Hashed key is 0x%08x\n", key, hashed_key);
-	h_list = &ht->table[hashed_key];
+	h_list = &tbl->buckets[hashed_key];
 	hlist_for_each_entry(entry, h_list, head)
 		DRM_DEBUG("count %d, key: 0x%08lx\n", count++, entry->key);
 }
@@ -78,10 +126,8 @@ static struct hlist_node *drm_ht_find_key(struct drm_open_hash *ht,
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
-	unsigned int hashed_key;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
+	h_list = drm_ht_bucket(drm_ht_get_table(ht), key);
 	hlist_for_each_entry(entry, h_list, head) {
 		if (entry->key == key)
 			return &entry->head;
@@ -96,42 +142,96 @@ static struct hlist_node *drm_ht_find_key_rcu(struct drm_open_hash *ht,
 {
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
-	unsigned int hashed_key;
+	struct hlist_node *found;
+	unsigned int seq;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	hlist_for_each_entry_rcu(entry, h_list, head) {
-		if (entry->key == key)
-			return &entry->head;
-		if (entry->key > key)
+	rcu_read_lock();
+	do {
+		found = NULL;
+		seq = read_seqcount_begin(&ht->resize_seq);
+		h_list = drm_ht_bucket(rcu_dereference(ht->table), key);
+		hlist_for_each_entry_rcu(entry, h_list, head) {
+			if (entry->key == key) {
+				found = &entry->head;
+				break;
+			}
+			if (entry->key > key)
+				break;
+		}
+	} while (!found && read_seqcount_retry(&ht->resize_seq, seq));
+	rcu_read_unlock();
+
+	return found;
+}
+
+static void drm_ht_link(struct hlist_head *h_list, struct drm_hash_item *item)
+{
+	struct drm_hash_item *entry;
+	struct hlist_node *parent = NULL;
+
+	hlist_for_each_entry(entry, h_list, head) {
+		if (entry->key > item->key)
 			break;
+		parent = &entry->head;
+	}
+	if (parent) {
+		hlist_add_behind_rcu(&item->head, parent);
+	} else {
+		hlist_add_head_rcu(&item->head, h_list);
 	}
-	return NULL;
+}
+
+static void drm_ht_grow(struct drm_open_hash *ht)
+{
+	struct drm_ht_table *old = drm_ht_get_table(ht);
+	struct drm_hash_item *entry;
+	struct drm_ht_table *tbl;
+	unsigned long i;
+
+	tbl = drm_ht_table_alloc(old->order + 1, GFP_NOWAIT | __GFP_NOWARN);
+	if (!tbl)
+		return;
+
+	preempt_disable();
+	write_seqcount_begin(&ht->resize_seq);
+	for (i = 0; i < (1UL << old->order); i++) {
+		while (!hlist_empty(&old->buckets[i])) {
+			entry = hlist_entry(old->buckets[i].first,
+					    struct drm_hash_item, head);
+			hlist_del_rcu(&entry->head);
+			drm_ht_link(drm_ht_bucket(tbl, entry->key), entry);
+		}
+	}
+	rcu_assign_pointer(ht->table, tbl);
+	write_seqcount_end(&ht->resize_seq);
+	preempt_enable();
+
+	ht->resizes++;
+	call_rcu(&old->rcu, drm_ht_table_free_rcu);
 }
 
 int drm_ht_insert_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
+	struct drm_ht_table *tbl = drm_ht_get_table(ht);
 	struct drm_hash_item *entry;
 	struct hlist_head *h_list;
-	struct hlist_node *parent;
-	unsigned int hashed_key;
 	unsigned long key = item->key;
+	unsigned int over;
 
-	hashed_key = hash_long(key, ht->order);
-	h_list = &ht->table[hashed_key];
-	parent = NULL;
+	h_list = drm_ht_bucket(tbl, key);
 	hlist_for_each_entry(entry, h_list, head) {
 		if (entry->key == key)
 			return -EINVAL;
 		if (entry->key > key)
 			break;
-		parent = &entry->head;
-	}
-	if (parent) {
-		hlist_add_behind_rcu(&item->head, parent);
-	} else {
-		hlist_add_head_rcu(&item->head, h_list);
 	}
+	drm_ht_link(h_list, item);
+
+	/* Try to grow on crossing the limit and after every further 2^order */
+	over = ++ht->count - (DRM_HT_MAX_LOAD << tbl->order);
+	if ((int)over > 0 && !((over - 1) & ((1U << tbl->order) - 1)) &&
+	    tbl->order < DRM_HT_MAX_ORDER)
+		drm_ht_grow(ht);
 	return 0;
 }
 
@@ -183,6 +283,7 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 	list = drm_ht_find_key(ht, key);
 	if (list) {
 		hlist_del_init_rcu(list);
+		ht->count--;
 		return 0;
 	}
 	return -EINVAL;
@@ -190,14 +291,63 @@ int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key)
 
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item)
 {
-	hlist_del_init_rcu(&item->head);
+	if (!hlist_unhashed(&item->head)) {
+		hlist_del_init_rcu(&item->head);
+		ht->count--;
+	}
 	return 0;
 }
 
 void drm_ht_remove(struct drm_open_hash *ht)
 {
-	if (ht->table) {
-		kvfree(ht->table);
-		ht->table = NULL;
+	struct drm_ht_table *tbl = drm_ht_get_table(ht);
+
+	if (tbl) {
+		RCU_INIT_POINTER(ht->table, NULL);
+		kvfree(tbl);
+	}
+	/* Wait for the arrays retired by drm_ht_grow() to be freed. */
+	if (ht->resizes)
+		rcu_barrier();
+}
+
+/**
+ * drm_ht_print_stats - print chain length statistics
+ * @ht: the hash table
+ * @p: the printer to dump to
+ *
+ * Walks all buckets and prints the table geometry, the load factor and a
+ * histogram of the chain lengths. The caller must hold whatever lock
+ * serializes the table manipulation functions.
+ */
+void drm_ht_print_stats(struct drm_open_hash *ht, struct drm_printer *p)
+{
+	struct drm_ht_table *tbl = drm_ht_get_table(ht);
+	unsigned int hist[DRM_HT_STATS_CHAINS + 1] = {};
+	unsigned int len, max_len = 0;
+	struct drm_hash_item *entry;
+	unsigned long i;
+
+	if (!tbl)
+		return;
+
+	for (i = 0; i < (1UL << tbl->order); i++) {
+		len = 0;
+		hlist_for_each_entry(entry, &tbl->buckets[i], head)
+			len++;
+		hist[min_t(unsigned int, len, DRM_HT_STATS_CHAINS)]++;
+		max_len = max(max_len, len);
 	}
+
+	drm_printf(p, "order: %u (initial %u), resizes: %u\n",
+		   tbl->order, ht->order, ht->resizes);
+	drm_printf(p, "items: %u, buckets: %lu, load: %u.%02u, max chain: %u\n",
+		   ht->count, 1UL << tbl->order,
+		   ht->count >> tbl->order,
+		   (unsigned int)((ht->count * 100UL >> tbl->order) % 100),
+		   max_len);
+	for (i = 0; i < DRM_HT_STATS_CHAINS; i++)
+		drm_printf(p, "chain %lu: %u\n", i, hist[i]);
+	drm_printf(p, "chain %u+: %u\n", DRM_HT_STATS_CHAINS,
+		   hist[DRM_HT_STATS_CHAINS]);
 }
@@ -183,9 +183,87 @@ int drm_gem_vmap(struct drm_gem_object *obj, struct iosys_map *map);
 void drm_gem_vunmap(struct drm_gem_object *obj, struct iosys_map *map);
 
 #ifdef __FreeBSD__
+#include <sys/counter.h>
+
 /* Need to find a proper way to do that */
 int drm_sysctl_init(struct drm_device *dev);
 int drm_sysctl_cleanup(struct drm_device *dev);
+
+/*
+ * Per-device counters exported below hw.dri.N.stats. They are counter(9)
+ * per-CPU counters, so updating them from the hot paths is a plain add.
+ */
+/*
+ * Ioctl latency histogram: bucket 0 counts calls below 2^10 ns, bucket n
+ * those in [2^(n + 9), 2^(n + 10)) ns and the last one everything longer.
+ */
+#define DRM_IOCTL_HIST_SHIFT	10
+#define DRM_IOCTL_HIST_BUCKETS	24
+
+struct drm_ioctl_stats {
+	counter_u64_t count;
+	counter_u64_t time_ns;
+	/* DRM_IOCTL_HIST_BUCKETS counters, allocated on first enable */
+	counter_u64_t *hist;
+};
+
+struct drm_stats {
+	/* Core ioctls by number, followed by the driver-private ones. */
+	unsigned int num_ioctls;
+	struct drm_ioctl_stats *ioctls;
+	/* Serializes enabling and resetting the ioctl statistics. */
+	struct mutex ioctl_lock;
+	unsigned int ioctl_hist;
+
+	counter_u64_t gem_objects;
+	counter_u64_t gem_bytes;
+
+	counter_u64_t vblank_events;
+	counter_u64_t vblank_latency_ns;
+};
+
+int drm_stats_init(struct drm_device *dev);
+void drm_sysctl_stats_driver_init(struct drm_device *dev);
+int drm_stats_ioctl_hist_enable(struct drm_device *dev, bool enable);
+void drm_stats_ioctl_reset(struct drm_device *dev);
+
+unsigned int drm_ioctl_stats_count(const struct drm_device *dev);
+const struct drm_ioctl_desc *drm_ioctl_stats_desc(const struct drm_device *dev,
+						  unsigned int index);
+
+static inline unsigned int drm_ioctl_hist_bucket(uint64_t ns)
+{
+	return min_t(unsigned int, fls64(ns >> DRM_IOCTL_HIST_SHIFT),
+		     DRM_IOCTL_HIST_BUCKETS - 1);
+}
+
+static inline void drm_stats_ioctl(struct drm_device *dev, unsigned int index,
+				   uint64_t ns)
+{
+	struct drm_ioctl_stats *stats = &dev->stats->ioctls[index];
+
+	counter_u64_add(stats->count, 1);
+	counter_u64_add(stats->time_ns, ns);
+	/* The acquire pairs with the release publishing the histograms. */
+	if (unlikely(atomic_load_acq_int(&dev->stats->ioctl_hist)))
+		counter_u64_add(stats->hist[drm_ioctl_hist_bucket(ns)], 1);
+}
+
+static inline void drm_stats_gem(struct drm_device *dev, int64_t objects,
+				 int64_t bytes)
+{
+	if (dev->stats == NULL)
+		return;
+	counter_u64_add(dev->stats->gem_objects, objects);
+	counter_u64_add(dev->stats->gem_bytes, bytes);
+}
+
+static inline void drm_stats_vblank_event(struct drm_device *dev,
+					  ktime_t latency)
+{
+	counter_u64_add(dev->stats->vblank_events, 1);
+	counter_u64_add(dev->stats->vblank_latency_ns, ktime_to_ns(latency));
+}
 #endif
 
 /* drm_debugfs.c drm_debugfs_crc.c */
@@ -43,6 +43,9 @@
 #include "drm_crtc_internal.h"
 #include "drm_internal.h"
 #include "drm_legacy.h"
+#ifdef __FreeBSD__
+#include "drm_trace_freebsd.h"
+#endif
 
 /**
  * DOC: getunique and setversion story
@@ -839,6 +842,11 @@ long drm_ioctl(struct file *filp,
 	char *kdata = NULL;
 	unsigned int in_size, out_size, drv_size, ksize;
 	bool is_driver_ioctl;
+#ifdef __FreeBSD__
+	unsigned int stats_index;
+	sbintime_t start;
+	uint64_t ns;
+#endif
 
 	dev = file_priv->minor->dev;
 
@@ -865,12 +873,18 @@ long drm_ioctl(struct file *filp,
 			goto err_i1;
 		index = array_index_nospec(index, dev->driver->num_ioctls);
 		ioctl = &dev->driver->ioctls[index];
+#ifdef __FreeBSD__
+		stats_index = DRM_CORE_IOCTL_COUNT + index;
+#endif
 	} else {
 		/* core ioctl */
 		if (nr >= DRM_CORE_IOCTL_COUNT)
 			goto err_i1;
 		nr = array_index_nospec(nr, DRM_CORE_IOCTL_COUNT);
 		ioctl = &drm_ioctls[nr];
+#ifdef __FreeBSD__
+		stats_index = nr;
+#endif
 	}
 
 	drv_size = _IOC_SIZE(ioctl->cmd);
@@ -913,7 +927,15 @@ long drm_ioctl(struct file *filp,
 	if (ksize > in_size)
 		memset(kdata + in_size, 0, ksize - in_size);
 
+#ifdef __FreeBSD__
+	start = sbinuptime();
+#endif
 	retcode = drm_ioctl_kernel(filp, func, kdata, ioctl->flags);
+#ifdef __FreeBSD__
+	ns = sbttons(sbinuptime() - start);
+	drm_stats_ioctl(dev, stats_index, ns);
+	trace_drm_ioctl(ioctl->name, nr, retcode, ns);
+#endif
 	if (copy_to_user((void __user *)arg, kdata, out_size) != 0)
 		retcode = -EFAULT;
 
@@ -959,3 +981,22 @@ bool drm_ioctl_flags(unsigned int nr, unsigned int *flags)
 	return true;
 }
 EXPORT_SYMBOL(drm_ioctl_flags);
+
+#ifdef __FreeBSD__
+/*
+ * Ioctl statistics are kept per slot: the core ioctls by number, then the
+ * driver-private ioctls by their offset from DRM_COMMAND_BASE.
+ */
+unsigned int drm_ioctl_stats_count(const struct drm_device *dev)
+{
+	return DRM_CORE_IOCTL_COUNT + dev->driver->num_ioctls;
+}
+
+const struct drm_ioctl_desc *drm_ioctl_stats_desc(const struct drm_device *dev,
+						  unsigned int index)
+{
+	if (index < DRM_CORE_IOCTL_COUNT)
+		return &drm_ioctls[index];
+	return &dev->driver->ioctls[index - DRM_CORE_IOCTL_COUNT];
+}
+#endif
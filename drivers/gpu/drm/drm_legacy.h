@@ -40,6 +40,7 @@ struct drm_device;
 struct drm_file;
 struct drm_hash_item;
 struct drm_open_hash;
+struct drm_printer;
 
 /*
  * Hash-table Support
@@ -60,6 +61,7 @@ void drm_ht_verbose_list(struct drm_open_hash *ht, unsigned long key);
 int drm_ht_remove_key(struct drm_open_hash *ht, unsigned long key);
 int drm_ht_remove_item(struct drm_open_hash *ht, struct drm_hash_item *item);
 void drm_ht_remove(struct drm_open_hash *ht);
+void drm_ht_print_stats(struct drm_open_hash *ht, struct drm_printer *p);
 #endif
 
 /*
@@ -69,7 +71,9 @@ void drm_ht_remove(struct drm_open_hash *ht);
  * hash table manipulation functions are never run simultaneously.
  * The lookup function drm_ht_find_item_rcu may, however, run simultaneously
  * with any of the manipulation functions as long as it's called from within
- * an RCU read-locked section.
+ * an RCU read-locked section. This includes insertions that grow the table:
+ * lookups racing with a resize are retried against the new bucket array.
+ * Insertions never sleep, growing the table only uses atomic allocations.
  */
 #define drm_ht_insert_item_rcu drm_ht_insert_item
 #define drm_ht_just_insert_please_rcu drm_ht_just_insert_please
@@ -50,6 +50,10 @@
 
 #include <drm/drm_mm.h>
 
+#ifdef __FreeBSD__
+#include "drm_trace_freebsd.h"
+#endif
+
 /**
  * DOC: Overview
  *
@@ -500,6 +504,9 @@ int drm_mm_reserve_node(struct drm_mm *mm, struct drm_mm_node *node)
 		add_hole(node);
 
 	save_stack(node);
+#ifdef __FreeBSD__
+	trace_drm_alloc(DRM_ALLOC_TRACE_MM, mm, node->start, node->size, 0);
+#endif
 	return 0;
 }
 EXPORT_SYMBOL(drm_mm_reserve_node);
@@ -618,6 +625,10 @@ int drm_mm_insert_node_in_range(struct drm_mm * const mm,
 			add_hole(node);
 
 		save_stack(node);
+#ifdef __FreeBSD__
+		trace_drm_alloc(DRM_ALLOC_TRACE_MM, mm, adj_start, size,
+				alignment);
+#endif
 		return 0;
 	}
 
@@ -646,6 +657,9 @@ void drm_mm_remove_node(struct drm_mm_node *node)
 	DRM_MM_BUG_ON(!drm_mm_node_allocated(node));
 	DRM_MM_BUG_ON(drm_mm_node_scanned_block(node));
 
+#ifdef __FreeBSD__
+	trace_drm_free(DRM_ALLOC_TRACE_MM, mm, node->start, node->size);
+#endif
 	prev_node = list_prev_entry(node, node_list);
 
 	if (drm_mm_hole_follows(node))
@@ -43,10 +43,15 @@
 #include <drm/drm_suballoc.h>
 #include <drm/drm_print.h>
 #include <linux/slab.h>
+#include <linux/smp.h>
 #include <linux/sched.h>
 #include <linux/wait.h>
 #include <linux/dma-fence.h>
 
+#ifdef __FreeBSD__
+#include "drm_trace_freebsd.h"
+#endif
+
 static void drm_suballoc_remove_locked(struct drm_suballoc *sa);
 static void drm_suballoc_try_free(struct drm_suballoc_manager *sa_manager);
 
@@ -73,8 +78,11 @@ void drm_suballoc_manager_init(struct drm_suballoc_manager *sa_manager,
 		align = roundup_pow_of_two(align);
 
 	init_waitqueue_head(&sa_manager->wq);
+	sa_manager->start = 0;
 	sa_manager->size = size;
 	sa_manager->align = align;
+	sa_manager->shards = NULL;
+	sa_manager->num_shards = 0;
 	sa_manager->hole = &sa_manager->olist;
 	INIT_LIST_HEAD(&sa_manager->olist);
 	for (i = 0; i < DRM_SUBALLOC_MAX_QUEUES; ++i)
@@ -82,6 +90,53 @@ void drm_suballoc_manager_init(struct drm_suballoc_manager *sa_manager,
 }
 EXPORT_SYMBOL(drm_suballoc_manager_init);
 
+/**
+ * drm_suballoc_manager_init_sharded() - Initialise a sharded drm_suballoc_manager
+ * @sa_manager: pointer to the sa_manager
+ * @size: number of bytes we want to suballocate
+ * @align: alignment for each suballocated chunk
+ * @num_shards: number of shards to split the range into
+ *
+ * Like drm_suballoc_manager_init(), but splits the range into @num_shards
+ * equally sized sub-rings, each with its own lock, hole and fence lists.
+ * Allocations are served from the shard of the current CPU and only fall
+ * over to the other shards when it is exhausted, so concurrent submitters
+ * do not contend on a single lock. A single allocation can not be larger
+ * than one shard.
+ *
+ * Return: 0 on success, negative error code on failure.
+ */
+int drm_suballoc_manager_init_sharded(struct drm_suballoc_manager *sa_manager,
+				      size_t size, size_t align,
+				      unsigned int num_shards)
+{
+	struct drm_suballoc_manager *shards;
+	size_t shard_size;
+	unsigned int i;
+
+	drm_suballoc_manager_init(sa_manager, size, align);
+
+	shard_size = num_shards ? round_down(size / num_shards,
+					     sa_manager->align) : 0;
+	if (num_shards <= 1 || !shard_size)
+		return 0;
+
+	shards = kcalloc(num_shards, sizeof(*shards), GFP_KERNEL);
+	if (!shards)
+		return -ENOMEM;
+
+	for (i = 0; i < num_shards; ++i) {
+		drm_suballoc_manager_init(&shards[i], shard_size,
+					  sa_manager->align);
+		shards[i].start = i * shard_size;
+	}
+
+	sa_manager->shards = shards;
+	sa_manager->num_shards = num_shards;
+	return 0;
+}
+EXPORT_SYMBOL(drm_suballoc_manager_init_sharded);
+
 /**
  * drm_suballoc_manager_fini() - Destroy the drm_suballoc_manager
  * @sa_manager: pointer to the sa_manager
@@ -97,6 +152,16 @@ void drm_suballoc_manager_fini(struct drm_suballoc_manager *sa_manager)
 	if (!sa_manager->size)
 		return;
 
+	if (sa_manager->shards) {
+		unsigned int i;
+
+		for (i = 0; i < sa_manager->num_shards; ++i)
+			drm_suballoc_manager_fini(&sa_manager->shards[i]);
+		kfree(sa_manager->shards);
+		sa_manager->shards = NULL;
+		sa_manager->num_shards = 0;
+	}
+
 	if (!list_empty(&sa_manager->olist)) {
 		sa_manager->hole = &sa_manager->olist;
 		drm_suballoc_try_free(sa_manager);
@@ -115,6 +180,10 @@ static void drm_suballoc_remove_locked(struct drm_suballoc *sa)
 {
 	struct drm_suballoc_manager *sa_manager = sa->manager;
 
+#ifdef __FreeBSD__
+	trace_drm_free(DRM_ALLOC_TRACE_SUBALLOC, sa_manager, sa->soffset,
+		       sa->eoffset - sa->soffset);
+#endif
 	if (sa_manager->hole == &sa->olist)
 		sa_manager->hole = sa->olist.prev;
 
@@ -147,7 +216,7 @@ static size_t drm_suballoc_hole_soffset(struct drm_suballoc_manager *sa_manager)
 	if (hole != &sa_manager->olist)
 		return list_entry(hole, struct drm_suballoc, olist)->eoffset;
 
-	return 0;
+	return sa_manager->start;
 }
 
 static size_t drm_suballoc_hole_eoffset(struct drm_suballoc_manager *sa_manager)
@@ -156,7 +225,7 @@ static size_t drm_suballoc_hole_eoffset(struct drm_suballoc_manager *sa_manager)
 
 	if (hole->next != &sa_manager->olist)
 		return list_entry(hole->next, struct drm_suballoc, olist)->soffset;
-	return sa_manager->size;
+	return sa_manager->start + sa_manager->size;
 }
 
 static bool drm_suballoc_try_alloc(struct drm_suballoc_manager *sa_manager,
@@ -178,6 +247,10 @@ static bool drm_suballoc_try_alloc(struct drm_suballoc_manager *sa_manager,
 		list_add(&sa->olist, sa_manager->hole);
 		INIT_LIST_HEAD(&sa->flist);
 		sa_manager->hole = &sa->olist;
+#ifdef __FreeBSD__
+		trace_drm_alloc(DRM_ALLOC_TRACE_SUBALLOC, sa_manager,
+				soffset, size, align);
+#endif
 		return true;
 	}
 	return false;
@@ -290,6 +363,27 @@ static bool drm_suballoc_next_hole(struct drm_suballoc_manager *sa_manager,
 	return false;
 }
 
+static bool drm_suballoc_try_new(struct drm_suballoc_manager *sa_manager,
+				 struct drm_suballoc *sa,
+				 size_t size, size_t align)
+{
+	struct dma_fence *fences[DRM_SUBALLOC_MAX_QUEUES];
+	unsigned int tries[DRM_SUBALLOC_MAX_QUEUES] = {};
+	bool ret = true;
+
+	spin_lock(&sa_manager->wq.lock);
+	do {
+		drm_suballoc_try_free(sa_manager);
+
+		if (drm_suballoc_try_alloc(sa_manager, sa, size, align))
+			goto out;
+	} while (drm_suballoc_next_hole(sa_manager, fences, tries));
+	ret = false;
+out:
+	spin_unlock(&sa_manager->wq.lock);
+	return ret;
+}
+
 /**
  * drm_suballoc_new() - Make a suballocation.
  * @sa_manager: pointer to the sa_manager
@@ -307,6 +401,9 @@ static bool drm_suballoc_next_hole(struct drm_suballoc_manager *sa_manager,
  * Try to make a suballocation of size @size, which will be rounded
  * up to the alignment specified in specified in drm_suballoc_manager_init().
  *
+ * For a sharded manager the shard of the current CPU is tried first, then
+ * the other shards, and only then do we wait for the current CPU's shard.
+ *
  * Return: a new suballocated bo, or an ERR_PTR.
  */
 struct drm_suballoc *
@@ -315,13 +412,18 @@ drm_suballoc_new(struct drm_suballoc_manager *sa_manager, size_t size,
 {
 	struct dma_fence *fences[DRM_SUBALLOC_MAX_QUEUES];
 	unsigned int tries[DRM_SUBALLOC_MAX_QUEUES];
+	struct drm_suballoc_manager *home = sa_manager;
 	unsigned int count;
 	int i, r;
 	struct drm_suballoc *sa;
 
 	if (WARN_ON_ONCE(align > sa_manager->align))
 		return ERR_PTR(-EINVAL);
-	if (WARN_ON_ONCE(size > sa_manager->size || !size))
+
+	if (sa_manager->shards)
+		home = &sa_manager->shards[raw_smp_processor_id() %
+					   sa_manager->num_shards];
+	if (WARN_ON_ONCE(size > home->size || !size))
 		return ERR_PTR(-EINVAL);
 
 	if (!align)
@@ -330,11 +432,23 @@ drm_suballoc_new(struct drm_suballoc_manager *sa_manager, size_t size,
 	sa = kmalloc(sizeof(*sa), gfp);
 	if (!sa)
 		return ERR_PTR(-ENOMEM);
-	sa->manager = sa_manager;
+	sa->manager = home;
 	sa->fence = NULL;
 	INIT_LIST_HEAD(&sa->olist);
 	INIT_LIST_HEAD(&sa->flist);
 
+	if (sa_manager->shards) {
+		unsigned int first = home - sa_manager->shards;
+		unsigned int n = sa_manager->num_shards;
+
+		for (i = 0; i < n; ++i)
+			if (drm_suballoc_try_new(&sa_manager->shards[(first + i) % n],
+						 sa, size, align))
+				return sa;
+
+		sa_manager = home;
+	}
+
 	spin_lock(&sa_manager->wq.lock);
 	do {
 		for (i = 0; i < DRM_SUBALLOC_MAX_QUEUES; ++i)
@@ -427,6 +541,17 @@ void drm_suballoc_dump_debug_info(struct drm_suballoc_manager *sa_manager,
 {
 	struct drm_suballoc *i;
 
+	if (sa_manager->shards) {
+		unsigned int s;
+
+		for (s = 0; s < sa_manager->num_shards; ++s) {
+			drm_printf(p, "shard %u:\n", s);
+			drm_suballoc_dump_debug_info(&sa_manager->shards[s], p,
+						     suballoc_base);
+		}
+		return;
+	}
+
 	spin_lock(&sa_manager->wq.lock);
 	list_for_each_entry(i, &sa_manager->olist, olist) {
 		unsigned long long soffset = i->soffset;
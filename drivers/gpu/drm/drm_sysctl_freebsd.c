@@ -30,6 +30,8 @@ __FBSDID("$FreeBSD$");
  */
 
 #include <drm/drm_drv.h>
+#include <drm/drm_ioctl.h>
+#include <drm/drm_managed.h>
 #include <drm/drm_print.h>
 #include <drm/drm_vblank.h>
 #include <uapi/drm/drm.h>
@@ -41,6 +43,8 @@ __FBSDID("$FreeBSD$");
 
 static int drm_add_busid_modesetting(struct drm_device *dev, struct sysctl_ctx_list *ctx,
 	   struct sysctl_oid *top);
+static int drm_add_stats(struct drm_device *dev, struct sysctl_ctx_list *ctx,
+	   struct sysctl_oid *top);
 
 SYSCTL_DECL(_hw_drm);
 
@@ -65,6 +69,7 @@ struct drm_sysctl_list {
 
 struct drm_sysctl_info {
 	struct sysctl_ctx_list ctx;
+	struct sysctl_oid     *stats;
 	char		       name[2];
 };
 
@@ -139,6 +144,7 @@ drm_sysctl_init(struct drm_device *dev)
 #endif
 
 	drm_add_busid_modesetting(dev, &info->ctx, top);
+	drm_add_stats(dev, &info->ctx, top);
 
 	SYSCTL_ADD_INT(&info->ctx, SYSCTL_CHILDREN(drioid), OID_AUTO,
 	    "vblank_offdelay", CTLFLAG_RW, &drm_vblank_offdelay,
@@ -194,6 +200,256 @@ drm_add_busid_modesetting(struct drm_device *dev, struct sysctl_ctx_list *ctx,
 	return (0);
 }
 
+static void
+drm_stats_counter_free(counter_u64_t *c)
+{
+	if (*c != NULL) {
+		counter_u64_free(*c);
+		*c = NULL;
+	}
+}
+
+static void
+drm_stats_release(struct drm_device *dev, void *res)
+{
+	struct drm_stats *stats = dev->stats;
+	unsigned int i;
+
+	dev->stats = NULL;
+	for (i = 0; i < stats->num_ioctls; i++) {
+		drm_stats_counter_free(&stats->ioctls[i].count);
+		drm_stats_counter_free(&stats->ioctls[i].time_ns);
+		if (stats->ioctls[i].hist != NULL) {
+			COUNTER_ARRAY_FREE(stats->ioctls[i].hist,
+			    DRM_IOCTL_HIST_BUCKETS);
+			free(stats->ioctls[i].hist, DRM_MEM_DRIVER);
+		}
+	}
+	free(stats->ioctls, DRM_MEM_DRIVER);
+	mutex_destroy(&stats->ioctl_lock);
+	drm_stats_counter_free(&stats->gem_objects);
+	drm_stats_counter_free(&stats->gem_bytes);
+	drm_stats_counter_free(&stats->vblank_events);
+	drm_stats_counter_free(&stats->vblank_latency_ns);
+	free(stats, DRM_MEM_DRIVER);
+}
+
+/*
+ * The counters live as long as the device rather than its sysctl tree:
+ * drivers create GEM objects well before the minors are registered.
+ */
+int
+drm_stats_init(struct drm_device *dev)
+{
+	struct drm_stats *stats;
+	unsigned int i;
+
+	stats = malloc(sizeof(*stats), DRM_MEM_DRIVER, M_WAITOK | M_ZERO);
+	mutex_init(&stats->ioctl_lock);
+	stats->num_ioctls = drm_ioctl_stats_count(dev);
+	stats->ioctls = mallocarray(stats->num_ioctls, sizeof(*stats->ioctls),
+	    DRM_MEM_DRIVER, M_WAITOK | M_ZERO);
+	for (i = 0; i < stats->num_ioctls; i++) {
+		/* Holes in the ioctl tables are never dispatched. */
+		if (drm_ioctl_stats_desc(dev, i)->func == NULL)
+			continue;
+		stats->ioctls[i].count = counter_u64_alloc(M_WAITOK);
+		stats->ioctls[i].time_ns = counter_u64_alloc(M_WAITOK);
+	}
+	stats->gem_objects = counter_u64_alloc(M_WAITOK);
+	stats->gem_bytes = counter_u64_alloc(M_WAITOK);
+	stats->vblank_events = counter_u64_alloc(M_WAITOK);
+	stats->vblank_latency_ns = counter_u64_alloc(M_WAITOK);
+	dev->stats = stats;
+
+	return (drmm_add_action_or_reset(dev, drm_stats_release, NULL));
+}
+
+/*
+ * The histograms are only allocated the first time they are enabled and
+ * stay around until the device goes away, so drm_ioctl() never has to
+ * synchronize with this.
+ */
+int
+drm_stats_ioctl_hist_enable(struct drm_device *dev, bool enable)
+{
+	struct drm_stats *stats = dev->stats;
+	struct drm_ioctl_stats *is;
+	counter_u64_t *hist;
+	unsigned int i;
+
+	mutex_lock(&stats->ioctl_lock);
+	if (enable) {
+		for (i = 0; i < stats->num_ioctls; i++) {
+			is = &stats->ioctls[i];
+			if (is->count == NULL || is->hist != NULL)
+				continue;
+			hist = mallocarray(DRM_IOCTL_HIST_BUCKETS,
+			    sizeof(*hist), DRM_MEM_DRIVER, M_WAITOK);
+			COUNTER_ARRAY_ALLOC(hist, DRM_IOCTL_HIST_BUCKETS,
+			    M_WAITOK);
+			is->hist = hist;
+		}
+	}
+	atomic_store_rel_int(&stats->ioctl_hist, enable);
+	mutex_unlock(&stats->ioctl_lock);
+
+	return (0);
+}
+
+void
+drm_stats_ioctl_reset(struct drm_device *dev)
+{
+	struct drm_stats *stats = dev->stats;
+	struct drm_ioctl_stats *is;
+	unsigned int i;
+
+	mutex_lock(&stats->ioctl_lock);
+	for (i = 0; i < stats->num_ioctls; i++) {
+		is = &stats->ioctls[i];
+		if (is->count == NULL)
+			continue;
+		counter_u64_zero(is->count);
+		counter_u64_zero(is->time_ns);
+		if (is->hist != NULL)
+			COUNTER_ARRAY_ZERO(is->hist, DRM_IOCTL_HIST_BUCKETS);
+	}
+	mutex_unlock(&stats->ioctl_lock);
+}
+
+static int
+drm_stats_ioctl_hist_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	int enable, error;
+
+	enable = atomic_load_acq_int(&dev->stats->ioctl_hist);
+	error = sysctl_handle_int(oidp, &enable, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	return (-drm_stats_ioctl_hist_enable(dev, enable != 0));
+}
+
+static int
+drm_stats_ioctl_reset_sysctl(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	int reset = 0, error;
+
+	error = sysctl_handle_int(oidp, &reset, 0, req);
+	if (error != 0 || req->newptr == NULL)
+		return (error);
+
+	if (reset != 0)
+		drm_stats_ioctl_reset(dev);
+	return (0);
+}
+
+static int
+drm_stats_ioctl_hist_show(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_device *dev = arg1;
+	struct drm_ioctl_stats *is = &dev->stats->ioctls[arg2];
+	uint64_t hist[DRM_IOCTL_HIST_BUCKETS] = {};
+
+	mutex_lock(&dev->stats->ioctl_lock);
+	if (is->hist != NULL)
+		COUNTER_ARRAY_COPY(is->hist, hist, DRM_IOCTL_HIST_BUCKETS);
+	mutex_unlock(&dev->stats->ioctl_lock);
+
+	return (SYSCTL_OUT(req, hist, sizeof(hist)));
+}
+
+static int
+drm_add_stats(struct drm_device *dev, struct sysctl_ctx_list *ctx,
+    struct sysctl_oid *top)
+{
+	struct drm_stats *stats = dev->stats;
+	struct sysctl_oid *node, *oid, *ioid;
+	const char *name;
+	unsigned int i;
+
+	if (stats == NULL)
+		return (0);
+
+	node = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(top), OID_AUTO, "stats",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "Device statistics");
+	if (node == NULL)
+		return (-ENOMEM);
+
+	oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "ioctl",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "Ioctl calls");
+	if (oid == NULL)
+		return (-ENOMEM);
+	for (i = 0; i < stats->num_ioctls; i++) {
+		if (stats->ioctls[i].count == NULL)
+			continue;
+		name = drm_ioctl_stats_desc(dev, i)->name;
+		if (strncmp(name, "DRM_IOCTL_", 10) == 0)
+			name += 10;
+		ioid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+		    name, CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, NULL);
+		if (ioid == NULL)
+			return (-ENOMEM);
+		SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(ioid), OID_AUTO,
+		    "count", CTLFLAG_RD, &stats->ioctls[i].count,
+		    "Number of calls");
+		SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(ioid), OID_AUTO,
+		    "time_ns", CTLFLAG_RD, &stats->ioctls[i].time_ns,
+		    "Time spent in the handler (ns)");
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(ioid), OID_AUTO, "hist",
+		    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, dev, i,
+		    drm_stats_ioctl_hist_show, "QU",
+		    "Calls per log2 latency bucket, the first one below 1024 ns");
+	}
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "hist_enable",
+	    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, dev, 0,
+	    drm_stats_ioctl_hist_sysctl, "I", "Record ioctl latency histograms");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "reset",
+	    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_MPSAFE, dev, 0,
+	    drm_stats_ioctl_reset_sysctl, "I", "Write 1 to clear the ioctl statistics");
+
+	oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "gem",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "GEM objects");
+	if (oid == NULL)
+		return (-ENOMEM);
+	SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "objects",
+	    CTLFLAG_RD, &stats->gem_objects, "Live GEM objects");
+	SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "bytes",
+	    CTLFLAG_RD, &stats->gem_bytes, "Size of live GEM objects");
+
+	oid = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "vblank",
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, "Vblank events");
+	if (oid == NULL)
+		return (-ENOMEM);
+	SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(oid), OID_AUTO, "events",
+	    CTLFLAG_RD, &stats->vblank_events, "Vblank and flip events sent");
+	SYSCTL_ADD_COUNTER_U64(ctx, SYSCTL_CHILDREN(oid), OID_AUTO,
+	    "latency_ns", CTLFLAG_RD, &stats->vblank_latency_ns,
+	    "Total time from vblank to event delivery (ns)");
+
+	dev->sysctl->stats = node;
+
+	return (0);
+}
+
+/*
+ * Drivers add their own counters once they are fully loaded: the ones with
+ * a legacy load hook only set up their memory managers after the minors,
+ * and with them the sysctl tree, have been registered.
+ */
+void
+drm_sysctl_stats_driver_init(struct drm_device *dev)
+{
+	struct drm_sysctl_info *info = dev->sysctl;
+
+	if (info == NULL || info->stats == NULL ||
+	    dev->driver->stats_sysctl_init == NULL)
+		return;
+
+	dev->driver->stats_sysctl_init(dev, &info->ctx, info->stats);
+}
 
 #define DRM_SYSCTL_PRINT(fmt, arg...)				\
 do {								\
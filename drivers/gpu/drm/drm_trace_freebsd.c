@@ -0,0 +1,275 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause-FreeBSD
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+
+#include "drm_trace_freebsd.h"
+
+/*
+ * Allocation trace ring buffer.
+ *
+ * Writing "1" to dri/alloc_trace starts recording alloc/free events of all
+ * drm_mm, drm_buddy and drm_suballoc instances, "0" stops it and "clear"
+ * drops the recorded events. Reading the file dumps the events, oldest
+ * first, one per line:
+ *
+ *   <ts_ns> <mm|buddy|sa> <alloc|free> <allocator> <start> <size> <arg>
+ *
+ * @arg is the requested alignment for drm_mm and drm_suballoc and the
+ * requested minimum block size for drm_buddy. Once the ring is full the
+ * oldest events are overwritten and reported as dropped.
+ */
+#define	DRM_ALLOC_TRACE_ENTRIES	(1 << 16)
+
+struct drm_alloc_trace_event {
+	uint64_t ts;
+	const void *allocator;
+	uint64_t start;
+	uint64_t size;
+	uint64_t arg;
+	uint8_t type;
+	bool alloc;
+};
+
+struct drm_alloc_trace_snapshot {
+	uint64_t dropped;
+	unsigned int count;
+	struct drm_alloc_trace_event events[];
+};
+
+bool drm_alloc_trace_enabled;
+
+static struct drm_alloc_trace_event *drm_alloc_trace_ring;
+static uint64_t drm_alloc_trace_head;
+static DEFINE_SPINLOCK(drm_alloc_trace_lock);
+static DEFINE_MUTEX(drm_alloc_trace_mutex);
+
+static const char * const drm_alloc_trace_names[] = {
+	[DRM_ALLOC_TRACE_MM] = "mm",
+	[DRM_ALLOC_TRACE_BUDDY] = "buddy",
+	[DRM_ALLOC_TRACE_SUBALLOC] = "sa",
+};
+
+void
+drm_alloc_trace_record(enum drm_alloc_trace_type type, bool alloc,
+    const void *allocator, uint64_t start, uint64_t size, uint64_t arg)
+{
+	struct drm_alloc_trace_event *ev;
+	uint64_t ts = ktime_get_ns();
+
+	spin_lock(&drm_alloc_trace_lock);
+	if (drm_alloc_trace_ring != NULL) {
+		ev = &drm_alloc_trace_ring[drm_alloc_trace_head++ &
+		    (DRM_ALLOC_TRACE_ENTRIES - 1)];
+		ev->ts = ts;
+		ev->allocator = allocator;
+		ev->start = start;
+		ev->size = size;
+		ev->arg = arg;
+		ev->type = type;
+		ev->alloc = alloc;
+	}
+	spin_unlock(&drm_alloc_trace_lock);
+}
+
+static void *
+drm_alloc_trace_seq_start(struct seq_file *m, loff_t *pos)
+{
+	struct drm_alloc_trace_snapshot *snap = m->private;
+
+	if (*pos == 0) {
+		seq_puts(m, "# ts_ns type op allocator start size arg\n");
+		if (snap->dropped)
+			seq_printf(m, "# dropped %ju\n",
+			    (uintmax_t)snap->dropped);
+	}
+
+	return *pos < snap->count ? &snap->events[*pos] : NULL;
+}
+
+static void *
+drm_alloc_trace_seq_next(struct seq_file *m, void *v, loff_t *pos)
+{
+	struct drm_alloc_trace_snapshot *snap = m->private;
+
+	++*pos;
+	return *pos < snap->count ? &snap->events[*pos] : NULL;
+}
+
+static void
+drm_alloc_trace_seq_stop(struct seq_file *m, void *v)
+{
+}
+
+static int
+drm_alloc_trace_seq_show(struct seq_file *m, void *v)
+{
+	struct drm_alloc_trace_event *ev = v;
+
+	seq_printf(m, "%ju %s %s %p 0x%jx 0x%jx 0x%jx\n", (uintmax_t)ev->ts,
+	    drm_alloc_trace_names[ev->type], ev->alloc ? "alloc" : "free",
+	    ev->allocator, (uintmax_t)ev->start, (uintmax_t)ev->size,
+	    (uintmax_t)ev->arg);
+
+	return 0;
+}
+
+static const struct seq_operations drm_alloc_trace_seq_ops = {
+	.start = drm_alloc_trace_seq_start,
+	.next = drm_alloc_trace_seq_next,
+	.stop = drm_alloc_trace_seq_stop,
+	.show = drm_alloc_trace_seq_show,
+};
+
+static int
+drm_alloc_trace_open(struct inode *inode, struct file *file)
+{
+	struct drm_alloc_trace_snapshot *snap;
+	unsigned int first, n;
+	uint64_t head;
+	int ret;
+
+	snap = kvzalloc(struct_size(snap, events, DRM_ALLOC_TRACE_ENTRIES),
+	    GFP_KERNEL);
+	if (snap == NULL)
+		return -ENOMEM;
+
+	/* Copy the ring out so that the dump does not stall the allocators. */
+	spin_lock(&drm_alloc_trace_lock);
+	if (drm_alloc_trace_ring != NULL) {
+		head = drm_alloc_trace_head;
+		snap->count = min_t(uint64_t, head, DRM_ALLOC_TRACE_ENTRIES);
+		snap->dropped = head - snap->count;
+		first = (head - snap->count) & (DRM_ALLOC_TRACE_ENTRIES - 1);
+		n = min(snap->count, DRM_ALLOC_TRACE_ENTRIES - first);
+		memcpy(snap->events, &drm_alloc_trace_ring[first],
+		    n * sizeof(*snap->events));
+		memcpy(&snap->events[n], drm_alloc_trace_ring,
+		    (snap->count - n) * sizeof(*snap->events));
+	}
+	spin_unlock(&drm_alloc_trace_lock);
+
+	ret = seq_open(file, &drm_alloc_trace_seq_ops);
+	if (ret) {
+		kvfree(snap);
+		return ret;
+	}
+	((struct seq_file *)file->private_data)->private = snap;
+
+	return 0;
+}
+
+static int
+drm_alloc_trace_release(struct inode *inode, struct file *file)
+{
+	struct seq_file *m = file->private_data;
+
+	kvfree(m->private);
+	return seq_release(inode, file);
+}
+
+static ssize_t
+drm_alloc_trace_write(struct file *file, const char __user *ubuf,
+    size_t len, loff_t *offp)
+{
+	struct drm_alloc_trace_event *ring;
+	char buf[8];
+
+	if (len > sizeof(buf) - 1)
+		return -EINVAL;
+
+	if (copy_from_user(buf, ubuf, len))
+		return -EFAULT;
+
+	buf[len] = '\0';
+
+	mutex_lock(&drm_alloc_trace_mutex);
+	if (sysfs_streq(buf, "1")) {
+		if (drm_alloc_trace_ring == NULL) {
+			ring = kvcalloc(DRM_ALLOC_TRACE_ENTRIES, sizeof(*ring),
+			    GFP_KERNEL);
+			if (ring == NULL) {
+				mutex_unlock(&drm_alloc_trace_mutex);
+				return -ENOMEM;
+			}
+			spin_lock(&drm_alloc_trace_lock);
+			drm_alloc_trace_ring = ring;
+			drm_alloc_trace_head = 0;
+			spin_unlock(&drm_alloc_trace_lock);
+		}
+		WRITE_ONCE(drm_alloc_trace_enabled, true);
+	} else if (sysfs_streq(buf, "0")) {
+		WRITE_ONCE(drm_alloc_trace_enabled, false);
+	} else if (sysfs_streq(buf, "clear")) {
+		spin_lock(&drm_alloc_trace_lock);
+		drm_alloc_trace_head = 0;
+		spin_unlock(&drm_alloc_trace_lock);
+	} else {
+		mutex_unlock(&drm_alloc_trace_mutex);
+		return -EINVAL;
+	}
+	mutex_unlock(&drm_alloc_trace_mutex);
+
+	return len;
+}
+
+static const struct file_operations drm_alloc_trace_fops = {
+	.owner = THIS_MODULE,
+	.open = drm_alloc_trace_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = drm_alloc_trace_release,
+	.write = drm_alloc_trace_write,
+};
+
+void
+drm_alloc_trace_debugfs_init(struct dentry *root)
+{
+	debugfs_create_file("alloc_trace", 0600, root, NULL,
+	    &drm_alloc_trace_fops);
+}
+
+void
+drm_alloc_trace_fini(void)
+{
+	struct drm_alloc_trace_event *ring;
+
+	WRITE_ONCE(drm_alloc_trace_enabled, false);
+
+	spin_lock(&drm_alloc_trace_lock);
+	ring = drm_alloc_trace_ring;
+	drm_alloc_trace_ring = NULL;
+	spin_unlock(&drm_alloc_trace_lock);
+
+	kvfree(ring);
+}
@@ -32,8 +32,10 @@
 #include <sys/param.h>
 #include <sys/ktr.h>
 
+#include <linux/compiler.h>
 #include <linux/ktime.h>
 
+struct dentry;
 struct drm_file;
 
 /* TRACE_EVENT(drm_vblank_event, */
@@ -62,4 +64,51 @@ trace_drm_vblank_event_delivered(struct drm_file *file, int crtc, unsigned int s
 	CTR3(KTR_DRM, "drm_vblank_event_delivered drm_file %p, crtc %d, seq %u", file, crtc, seq);
 }
 
+static inline void
+trace_drm_ioctl(const char *name, unsigned int nr, int ret, uint64_t ns)
+{
+	CTR4(KTR_DRM, "drm_ioctl %s nr 0x%02x, ret %d, %ju ns", name, nr, ret,
+	    (uintmax_t)ns);
+}
+
+/*
+ * Allocation trace of the range allocators (drm_mm, drm_buddy and
+ * drm_suballoc). Events are kept in a ring buffer exposed through the
+ * dri/alloc_trace debugfs file, so that allocation patterns seen on real
+ * hardware can be captured and replayed offline.
+ */
+enum drm_alloc_trace_type {
+	DRM_ALLOC_TRACE_MM,
+	DRM_ALLOC_TRACE_BUDDY,
+	DRM_ALLOC_TRACE_SUBALLOC,
+};
+
+extern bool drm_alloc_trace_enabled;
+
+void drm_alloc_trace_record(enum drm_alloc_trace_type type, bool alloc,
+    const void *allocator, uint64_t start, uint64_t size, uint64_t arg);
+void drm_alloc_trace_debugfs_init(struct dentry *root);
+void drm_alloc_trace_fini(void);
+
+static inline void
+trace_drm_alloc(enum drm_alloc_trace_type type, const void *allocator,
+    uint64_t start, uint64_t size, uint64_t arg)
+{
+	CTR5(KTR_DRM, "drm_alloc type %d, allocator %p, start 0x%jx, "
+	    "size 0x%jx, arg 0x%jx", type, allocator, (uintmax_t)start,
+	    (uintmax_t)size, (uintmax_t)arg);
+	if (unlikely(READ_ONCE(drm_alloc_trace_enabled)))
+		drm_alloc_trace_record(type, true, allocator, start, size, arg);
+}
+
+static inline void
+trace_drm_free(enum drm_alloc_trace_type type, const void *allocator,
+    uint64_t start, uint64_t size)
+{
+	CTR4(KTR_DRM, "drm_free type %d, allocator %p, start 0x%jx, "
+	    "size 0x%jx", type, allocator, (uintmax_t)start, (uintmax_t)size);
+	if (unlikely(READ_ONCE(drm_alloc_trace_enabled)))
+		drm_alloc_trace_record(type, false, allocator, start, size, 0);
+}
+
 #endif
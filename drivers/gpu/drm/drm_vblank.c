@@ -1057,6 +1057,9 @@ static void send_vblank_event(struct drm_device *dev,
 		break;
 	}
 	trace_drm_vblank_event_delivered(e->base.file_priv, e->pipe, seq);
+#ifdef __FreeBSD__
+	drm_stats_vblank_event(dev, ktime_sub(ktime_get(), now));
+#endif
 	/*
 	 * Use the same timestamp for any associated fence signal to avoid
 	 * mismatch in timestamps for vsync & fence events triggered by the
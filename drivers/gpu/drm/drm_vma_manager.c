@@ -240,6 +240,18 @@ void drm_vma_offset_remove(struct drm_vma_offset_manager *mgr,
 }
 EXPORT_SYMBOL(drm_vma_offset_remove);
 
+static int vma_node_inline_find(struct drm_vma_offset_node *node,
+				struct drm_file *tag)
+{
+	int i;
+
+	for (i = 0; i < DRM_VMA_NODE_INLINE_FILES; i++)
+		if (READ_ONCE(node->vm_inline_tag[i]) == tag)
+			return i;
+
+	return -1;
+}
+
 static int vma_node_allow(struct drm_vma_offset_node *node,
 			  struct drm_file *tag, bool ref_counted)
 {
@@ -247,6 +259,7 @@ static int vma_node_allow(struct drm_vma_offset_node *node,
 	struct rb_node *parent = NULL;
 	struct drm_vma_offset_file *new, *entry;
 	int ret = 0;
+	int slot;
 
 	/* Preallocate entry to avoid atomic allocations below. It is quite
 	 * unlikely that an open-file is added twice to a single node so we
@@ -273,6 +286,21 @@ static int vma_node_allow(struct drm_vma_offset_node *node,
 		}
 	}
 
+	/* Files are tracked inline while there is a free slot. */
+	slot = vma_node_inline_find(node, tag);
+	if (slot < 0)
+		slot = vma_node_inline_find(node, NULL);
+	if (slot >= 0) {
+		if (node->vm_inline_tag[slot] == tag) {
+			if (ref_counted)
+				node->vm_inline_count[slot]++;
+		} else {
+			node->vm_inline_count[slot] = 1;
+			WRITE_ONCE(node->vm_inline_tag[slot], tag);
+		}
+		goto unlock;
+	}
+
 	if (!new) {
 		ret = -ENOMEM;
 		goto unlock;
@@ -359,9 +387,18 @@ void drm_vma_node_revoke(struct drm_vma_offset_node *node,
 {
 	struct drm_vma_offset_file *entry;
 	struct rb_node *iter;
+	int slot;
 
 	write_lock(&node->vm_lock);
 
+	slot = vma_node_inline_find(node, tag);
+	if (slot >= 0) {
+		if (!--node->vm_inline_count[slot])
+			WRITE_ONCE(node->vm_inline_tag[slot], NULL);
+		write_unlock(&node->vm_lock);
+		return;
+	}
+
 	iter = node->vm_files.rb_node;
 	while (likely(iter)) {
 		entry = rb_entry(iter, struct drm_vma_offset_file, vm_rb);
@@ -401,6 +438,17 @@ bool drm_vma_node_is_allowed(struct drm_vma_offset_node *node,
 	struct drm_vma_offset_file *entry;
 	struct rb_node *iter;
 
+	/*
+	 * The inline slots and the tree root are checked without the lock,
+	 * racing with allow/revoke gives either the old or the new answer,
+	 * just as if we had been ordered before or after them.
+	 */
+	if (vma_node_inline_find(node, tag) >= 0)
+		return true;
+
+	if (!READ_ONCE(node->vm_files.rb_node))
+		return false;
+
 	read_lock(&node->vm_lock);
 
 	iter = node->vm_files.rb_node;
@@ -314,6 +314,10 @@ int i915_ttm_buddy_man_init(struct ttm_device *bdev,
 	if (err)
 		goto err_free_bman;
 
+	err = drm_buddy_cache_init(&bman->mm);
+	if (err)
+		goto err_fini_buddy;
+
 	mutex_init(&bman->lock);
 	INIT_LIST_HEAD(&bman->reserved);
 	GEM_BUG_ON(default_page_size < chunk_size);
@@ -331,6 +335,8 @@ int i915_ttm_buddy_man_init(struct ttm_device *bdev,
 
 	return 0;
 
+err_fini_buddy:
+	drm_buddy_fini(&bman->mm);
 err_free_bman:
 	kfree(bman);
 	return err;
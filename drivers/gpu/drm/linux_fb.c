@@ -297,152 +297,457 @@ linux_fb_get_options(const char *connector_name, char **option)
  * Routines to write to the framebuffer. They are used to implement Linux'
  * fbdev equivalent functions below.
  *
- * Copied from `sys/dev/vt/hw/fb/vt_fb.c`.
+ * Drawing is done one scanline span at a time: the rectangle is clipped and
+ * checked against the framebuffer size once, the address of each row is
+ * computed once and the inner loops are specialized per pixel size. This
+ * matters on large consoles where a blank or a scroll touches millions of
+ * pixels.
  */
 
+typedef void fb_fill_span_t(uint8_t *, uint32_t, uint32_t);
+typedef void fb_blit_span_t(uint8_t *, const uint8_t *, uint32_t,
+    const uint8_t (*)[16]);
+
+void
+linux_fb_surface_init(struct linux_fb_surface *surf,
+    struct linux_fb_info *info, void *base, size_t size)
+{
+	surf->base = base;
+	surf->size = size;
+	surf->line_length = info->fix.line_length;
+	surf->cpp = info->var.bits_per_pixel / 8;
+	surf->width = info->var.xres;
+	surf->height = info->var.yres;
+}
+
 static void
-fb_mem_wr1(struct linux_fb_info *info, uint32_t offset, uint8_t value)
+fb_surface_from_info(struct linux_fb_surface *surf,
+    struct linux_fb_info *info)
 {
+	linux_fb_surface_init(surf, info, info->screen_base,
+	    info->screen_size != 0 ? info->screen_size : info->fix.smem_len);
+}
+
+static inline uint8_t *
+fb_line(const struct linux_fb_surface *surf, uint32_t x, uint32_t y)
+{
+	return (surf->base +
+	    (size_t)surf->line_length * y + (size_t)x * surf->cpp);
+}
+
+/*
+ * Clip the rectangle at (x, y) to the visible area. Returns false if there is
+ * nothing left to draw.
+ */
+static bool
+fb_clip_rect(const struct linux_fb_surface *surf, uint32_t x, uint32_t y,
+    uint32_t *width, uint32_t *height)
+{
+	if (x >= surf->width || y >= surf->height)
+		return (false);
+	if (*width > surf->width - x)
+		*width = surf->width - x;
+	if (*height > surf->height - y)
+		*height = surf->height - y;
+	if (*width == 0 || *height == 0)
+		return (false);
+
+	KASSERT((surf->base != NULL), ("Unmapped framebuffer"));
 	KASSERT(
-	    (offset < info->screen_size),
-	    ("Offset %#08x out of framebuffer size", offset));
-	*(uint8_t *)(info->screen_base + offset) = value;
+	    ((size_t)surf->line_length * (y + *height - 1) +
+	     (size_t)(x + *width) * surf->cpp <= surf->size),
+	    ("Rectangle %ux%u at %u,%u out of framebuffer size",
+	     *width, *height, x, y));
+
+	return (true);
 }
 
 static void
-fb_mem_wr2(struct linux_fb_info *info, uint32_t offset, uint16_t value)
+fb_fill_span8(uint8_t *dst, uint32_t width, uint32_t color)
 {
-	KASSERT(
-	    (offset < info->screen_size),
-	    ("Offset %#08x out of framebuffer size", offset));
-	*(uint16_t *)(info->screen_base + offset) = value;
+	memset(dst, color & 0xff, width);
 }
 
 static void
-fb_mem_wr4(struct linux_fb_info *info, uint32_t offset, uint32_t value)
+fb_fill_span16(uint8_t *dst, uint32_t width, uint32_t color)
 {
-	KASSERT(
-	    (offset < info->screen_size),
-	    ("Offset %#08x out of framebuffer size", offset));
-	*(uint32_t *)(info->screen_base + offset) = value;
+	uint16_t *p;
+	uint32_t color2;
+
+	p = (uint16_t *)dst;
+	if (((uintptr_t)p & 2) != 0 && width > 0) {
+		*p++ = color;
+		width--;
+	}
+
+	/* Both halves are the same pixel, so this is endian-neutral. */
+	color2 = (color & 0xffff) | (color << 16);
+	for (; width >= 2; width -= 2, p += 2)
+		*(uint32_t *)p = color2;
+
+	if (width > 0)
+		*p = color;
 }
 
 static void
-fb_setpixel(struct linux_fb_info *info, uint32_t x, uint32_t y,
-    uint32_t color)
+fb_fill_span24(uint8_t *dst, uint32_t width, uint32_t color)
 {
-	uint32_t bytes_per_pixel;
-	unsigned int offset;
+	for (; width > 0; width--, dst += 3) {
+		dst[0] = (color >> 16) & 0xff;
+		dst[1] = (color >> 8) & 0xff;
+		dst[2] = color & 0xff;
+	}
+}
+
+static void
+fb_fill_span32(uint8_t *dst, uint32_t width, uint32_t color)
+{
+	uint32_t *p;
+	uint64_t color2;
+
+	p = (uint32_t *)dst;
+	if (((uintptr_t)p & 4) != 0 && width > 0) {
+		*p++ = color;
+		width--;
+	}
 
-	bytes_per_pixel = info->var.bits_per_pixel / 8;
-	offset = info->fix.line_length * y + x * bytes_per_pixel;
+	color2 = ((uint64_t)color << 32) | color;
+	for (; width >= 8; width -= 8, p += 8) {
+		((uint64_t *)p)[0] = color2;
+		((uint64_t *)p)[1] = color2;
+		((uint64_t *)p)[2] = color2;
+		((uint64_t *)p)[3] = color2;
+	}
+	for (; width >= 2; width -= 2, p += 2)
+		*(uint64_t *)p = color2;
 
-	KASSERT((info->screen_base != 0), ("Unmapped framebuffer"));
+	if (width > 0)
+		*p = color;
+}
 
-	switch (bytes_per_pixel) {
+static fb_fill_span_t *
+fb_fill_span_func(uint32_t cpp)
+{
+	switch (cpp) {
 	case 1:
-		fb_mem_wr1(info, offset, color);
+		return (fb_fill_span8);
+	case 2:
+		return (fb_fill_span16);
+	case 3:
+		return (fb_fill_span24);
+	case 4:
+		return (fb_fill_span32);
+	default:
+		return (NULL);
+	}
+}
+
+/*
+ * Glyphs are expanded from 1bpp using a table indexed by a nibble of the
+ * source bitmap: each entry holds the four pixels (up to 16 bytes) this
+ * nibble expands to, already in framebuffer byte order. The table is built
+ * once per image, then each source byte turns into two fixed-size copies.
+ */
+
+static void
+fb_pixel_bytes(uint8_t *dst, uint32_t color, uint32_t cpp)
+{
+	uint16_t color16;
+
+	switch (cpp) {
+	case 1:
+		dst[0] = color & 0xff;
 		break;
 	case 2:
-		fb_mem_wr2(info, offset, color);
+		color16 = color;
+		memcpy(dst, &color16, sizeof(color16));
 		break;
 	case 3:
-		fb_mem_wr1(info, offset, (color >> 16) & 0xff);
-		fb_mem_wr1(info, offset + 1, (color >> 8) & 0xff);
-		fb_mem_wr1(info, offset + 2, color & 0xff);
+		dst[0] = (color >> 16) & 0xff;
+		dst[1] = (color >> 8) & 0xff;
+		dst[2] = color & 0xff;
 		break;
 	case 4:
-		fb_mem_wr4(info, offset, color);
+		memcpy(dst, &color, sizeof(color));
 		break;
-	default:
-		/* panic? */
-		return;
 	}
 }
 
-void
-cfb_fillrect(struct linux_fb_info *info, const struct fb_fillrect *rect)
+static void
+fb_glyph_tab_init(uint8_t tab[16][16], uint32_t fg, uint32_t bg, uint32_t cpp)
 {
-	uint32_t x, y;
+	uint32_t nibble, i;
 
-	if (info->fbio.fb_flags & FB_FLAG_NOWRITE)
+	for (nibble = 0; nibble < 16; nibble++)
+		for (i = 0; i < 4; i++)
+			fb_pixel_bytes(&tab[nibble][i * cpp],
+			    (nibble & (0x8 >> i)) ? fg : bg, cpp);
+}
+
+static __always_inline void
+fb_blit_span(uint8_t *dst, const uint8_t *src, uint32_t width,
+    const uint8_t (*tab)[16], const uint32_t cpp)
+{
+	const uint32_t nibble_size = 4 * cpp;
+	uint8_t bits;
+
+	for (; width >= 8; width -= 8, dst += 2 * nibble_size) {
+		bits = *src++;
+		memcpy(dst, tab[bits >> 4], nibble_size);
+		memcpy(dst + nibble_size, tab[bits & 0xf], nibble_size);
+	}
+	if (width == 0)
 		return;
 
-	KASSERT(
-	    (rect->rop == ROP_COPY),
-	    ("`rect->rop=%u` is unsupported in cfb_fillrect()", rect->rop));
+	bits = *src;
+	if (width >= 4) {
+		memcpy(dst, tab[bits >> 4], nibble_size);
+		dst += nibble_size;
+		bits <<= 4;
+		width -= 4;
+	}
+	if (width > 0)
+		memcpy(dst, tab[bits >> 4], width * cpp);
+}
+
+static void
+fb_blit_span8(uint8_t *dst, const uint8_t *src, uint32_t width,
+    const uint8_t (*tab)[16])
+{
+	fb_blit_span(dst, src, width, tab, 1);
+}
+
+static void
+fb_blit_span16(uint8_t *dst, const uint8_t *src, uint32_t width,
+    const uint8_t (*tab)[16])
+{
+	fb_blit_span(dst, src, width, tab, 2);
+}
+
+static void
+fb_blit_span24(uint8_t *dst, const uint8_t *src, uint32_t width,
+    const uint8_t (*tab)[16])
+{
+	fb_blit_span(dst, src, width, tab, 3);
+}
+
+static void
+fb_blit_span32(uint8_t *dst, const uint8_t *src, uint32_t width,
+    const uint8_t (*tab)[16])
+{
+	fb_blit_span(dst, src, width, tab, 4);
+}
 
-	for (y = rect->dy; y < rect->dy + rect->height; ++y) {
-		for (x = rect->dx; x < rect->dx + rect->width; ++x) {
-			fb_setpixel(info, x, y, rect->color);
+static fb_blit_span_t *
+fb_blit_span_func(uint32_t cpp)
+{
+	switch (cpp) {
+	case 1:
+		return (fb_blit_span8);
+	case 2:
+		return (fb_blit_span16);
+	case 3:
+		return (fb_blit_span24);
+	case 4:
+		return (fb_blit_span32);
+	default:
+		return (NULL);
+	}
+}
+
+/*
+ * Only draw the pixels set in `mask`, in the foreground color. This is used
+ * for the mouse pointer, so it is kept simple: fully transparent bytes are
+ * skipped and runs of set bits are filled as spans.
+ */
+static void
+fb_blit_span_masked(uint8_t *dst, const uint8_t *mask, uint32_t width,
+    uint32_t color, uint32_t cpp, fb_fill_span_t *fill)
+{
+	uint32_t xi, run;
+
+	xi = 0;
+	while (xi < width) {
+		if ((xi % 8) == 0 && mask[xi / 8] == 0) {
+			xi += 8;
+			continue;
 		}
+		if ((mask[xi / 8] & (0x80 >> (xi % 8))) == 0) {
+			xi++;
+			continue;
+		}
+		for (run = 1; xi + run < width; run++)
+			if ((mask[(xi + run) / 8] &
+			    (0x80 >> ((xi + run) % 8))) == 0)
+				break;
+		fill(dst + xi * cpp, run, color);
+		xi += run;
 	}
 }
 
 void
-cfb_copyarea(struct linux_fb_info *info, const struct fb_copyarea *area)
+linux_fb_surface_fillrect(const struct linux_fb_surface *surf,
+    const struct fb_fillrect *rect)
 {
-	panic("cfb_copyarea() not implemented");
+	fb_fill_span_t *fill;
+	uint32_t width, height, yi;
+	uint8_t *dst;
+
+	KASSERT(
+	    (rect->rop == ROP_COPY),
+	    ("`rect->rop=%u` is unsupported in cfb_fillrect()", rect->rop));
+
+	fill = fb_fill_span_func(surf->cpp);
+	if (fill == NULL)
+		return;
+
+	width = rect->width;
+	height = rect->height;
+	if (!fb_clip_rect(surf, rect->dx, rect->dy, &width, &height))
+		return;
+
+	dst = fb_line(surf, rect->dx, rect->dy);
+	for (yi = 0; yi < height; ++yi, dst += surf->line_length)
+		fill(dst, width, rect->color);
 }
 
+/*
+ * Source and destination may overlap (this is how the console scrolls), so
+ * rows are moved with memmove(9) and walked bottom-up when the destination
+ * is below the source.
+ */
 void
-cfb_imageblit(struct linux_fb_info *info, const struct fb_image *image)
+linux_fb_surface_copyarea(const struct linux_fb_surface *surf,
+    const struct fb_copyarea *area)
 {
-	uint32_t x, y, width, height, xi, yi;
-	uint32_t bytes_per_img_line, bit, byte, color;
+	uint32_t width, height, yi;
+	size_t line_length, len;
+	uint8_t *dst, *src;
 
-	if (info->fbio.fb_flags & FB_FLAG_NOWRITE)
+	if (surf->cpp == 0 || surf->cpp > 4)
+		return;
+
+	width = area->width;
+	height = area->height;
+	if (!fb_clip_rect(surf, area->sx, area->sy, &width, &height) ||
+	    !fb_clip_rect(surf, area->dx, area->dy, &width, &height))
+		return;
+
+	line_length = surf->line_length;
+	len = (size_t)width * surf->cpp;
+	src = fb_line(surf, area->sx, area->sy);
+	dst = fb_line(surf, area->dx, area->dy);
+
+	/* Whole scanlines are contiguous: move them in one go. */
+	if (area->sx == 0 && area->dx == 0 && width == surf->width) {
+		memmove(dst, src, line_length * (height - 1) + len);
 		return;
+	}
+
+	if (area->dy > area->sy) {
+		src += line_length * (height - 1);
+		dst += line_length * (height - 1);
+		for (yi = 0; yi < height; ++yi) {
+			memmove(dst, src, len);
+			src -= line_length;
+			dst -= line_length;
+		}
+	} else {
+		for (yi = 0; yi < height; ++yi) {
+			memmove(dst, src, len);
+			src += line_length;
+			dst += line_length;
+		}
+	}
+}
+
+void
+linux_fb_surface_imageblit(const struct linux_fb_surface *surf,
+    const struct fb_image *image)
+{
+	fb_fill_span_t *fill;
+	fb_blit_span_t *blit;
+	uint8_t tab[16][16];
+	const uint8_t *src;
+	uint32_t width, height, yi;
+	uint32_t bytes_per_img_line;
+	uint8_t *dst;
 
 	KASSERT(
 	    (image->depth == 1),
 	    ("`image->depth=%u` is unsupported in cfb_imageblit()",
 	     image->depth));
 
-	bytes_per_img_line = (image->width + 7) / 8;
+	fill = fb_fill_span_func(surf->cpp);
+	blit = fb_blit_span_func(surf->cpp);
+	if (fill == NULL || blit == NULL)
+		return;
 
-	x = image->dx;
-	y = image->dy;
 	width = image->width;
 	height = image->height;
+	if (!fb_clip_rect(surf, image->dx, image->dy, &width, &height))
+		return;
 
-	if (x + width > info->var.xres) {
-		if (x >= info->var.xres)
-			return;
-		width = info->var.xres - x;
-	}
-	if (y + height > info->var.yres) {
-		if (y >= info->var.yres)
-			return;
-		height = info->var.yres - y;
-	}
+	/* The source stride is based on the unclipped width. */
+	bytes_per_img_line = (image->width + 7) / 8;
+	dst = fb_line(surf, image->dx, image->dy);
 
 	if (image->mask == NULL) {
+		fb_glyph_tab_init(tab, image->fg_color, image->bg_color,
+		    surf->cpp);
+		src = (const uint8_t *)image->data;
 		for (yi = 0; yi < height; ++yi) {
-			for (xi = 0; xi < width; ++xi) {
-				byte = yi * bytes_per_img_line + xi / 8;
-				bit = 0x80 >> (xi % 8);
-				color = image->data[byte] & bit ?
-				    image->fg_color : image->bg_color;
-
-				fb_setpixel(info, x + xi, y + yi, color);
-			}
+			blit(dst, src, width, (const uint8_t (*)[16])tab);
+			src += bytes_per_img_line;
+			dst += surf->line_length;
 		}
 	} else {
+		src = (const uint8_t *)image->mask;
 		for (yi = 0; yi < height; ++yi) {
-			for (xi = 0; xi < width; ++xi) {
-				byte = yi * bytes_per_img_line + xi / 8;
-				bit = 0x80 >> (xi % 8);
-				if (image->mask[byte] & bit) {
-					color = image->fg_color;
-
-					fb_setpixel(info, x + xi, y + yi, color);
-				}
-			}
+			fb_blit_span_masked(dst, src, width, image->fg_color,
+			    surf->cpp, fill);
+			src += bytes_per_img_line;
+			dst += surf->line_length;
 		}
 	}
 }
 
+void
+cfb_fillrect(struct linux_fb_info *info, const struct fb_fillrect *rect)
+{
+	struct linux_fb_surface surf;
+
+	if (info->fbio.fb_flags & FB_FLAG_NOWRITE)
+		return;
+
+	fb_surface_from_info(&surf, info);
+	linux_fb_surface_fillrect(&surf, rect);
+}
+
+void
+cfb_copyarea(struct linux_fb_info *info, const struct fb_copyarea *area)
+{
+	struct linux_fb_surface surf;
+
+	if (info->fbio.fb_flags & FB_FLAG_NOWRITE)
+		return;
+
+	fb_surface_from_info(&surf, info);
+	linux_fb_surface_copyarea(&surf, area);
+}
+
+void
+cfb_imageblit(struct linux_fb_info *info, const struct fb_image *image)
+{
+	struct linux_fb_surface surf;
+
+	if (info->fbio.fb_flags & FB_FLAG_NOWRITE)
+		return;
+
+	fb_surface_from_info(&surf, info);
+	linux_fb_surface_imageblit(&surf, image);
+}
+
 void
 sys_fillrect(struct linux_fb_info *info, const struct fb_fillrect *rect)
 {
@@ -95,6 +95,7 @@ extern int radeon_r4xx_atom;
 extern int radeon_agpmode;
 extern int radeon_vram_limit;
 extern int radeon_gart_size;
+extern int radeon_vram_reclaim;
 extern int radeon_benchmarking;
 extern int radeon_testing;
 extern int radeon_connector_table;
@@ -129,6 +129,7 @@ int radeon_r4xx_atom;
 int radeon_agpmode = -1;
 int radeon_vram_limit;
 int radeon_gart_size = -1; /* auto */
+int radeon_vram_reclaim = 95;
 int radeon_benchmarking;
 int radeon_testing;
 int radeon_connector_table;
@@ -175,6 +176,9 @@ module_param_named(agpmode, radeon_agpmode, int, 0444);
 MODULE_PARM_DESC(gartsize, "Size of PCIE/IGP gart to setup in megabytes (32, 64, etc., -1 = auto)");
 module_param_named(gartsize, radeon_gart_size, int, 0600);
 
+MODULE_PARM_DESC(vram_reclaim, "VRAM usage in percent above which to evict in the background (95 = default, 0 = off)");
+module_param_named(vram_reclaim, radeon_vram_reclaim, int, 0444);
+
 MODULE_PARM_DESC(benchmark, "Run benchmark");
 module_param_named(benchmark, radeon_benchmarking, int, 0444);
 
@@ -578,6 +582,17 @@ static const struct drm_ioctl_desc radeon_ioctls_kms[] = {
 	DRM_IOCTL_DEF_DRV(RADEON_GEM_USERPTR, radeon_gem_userptr_ioctl, DRM_AUTH|DRM_RENDER_ALLOW),
 };
 
+#ifdef __FreeBSD__
+static void radeon_stats_sysctl_init(struct drm_device *dev,
+				     struct sysctl_ctx_list *ctx,
+				     struct sysctl_oid *node)
+{
+	struct radeon_device *rdev = dev->dev_private;
+
+	ttm_pool_sysctl_init(&rdev->mman.bdev.pool, ctx, node);
+}
+#endif
+
 static const struct drm_driver kms_driver = {
 	.driver_features =
 	    DRIVER_GEM | DRIVER_RENDER | DRIVER_MODESET,
@@ -590,6 +605,9 @@ static const struct drm_driver kms_driver = {
 	.dumb_create = radeon_mode_dumb_create,
 	.dumb_map_offset = radeon_mode_dumb_mmap,
 	.fops = &radeon_driver_kms_fops,
+#ifdef __FreeBSD__
+	.stats_sysctl_init = radeon_stats_sysctl_init,
+#endif
 
 	.gem_prime_import_sg_table = radeon_gem_prime_import_sg_table,
 
@@ -776,6 +776,7 @@ void radeon_ttm_fini(struct radeon_device *rdev)
 void radeon_ttm_set_active_vram_size(struct radeon_device *rdev, u64 size)
 {
 	struct ttm_resource_manager *man;
+	u64 high;
 
 	if (!rdev->mman.initialized)
 		return;
@@ -783,6 +784,13 @@ void radeon_ttm_set_active_vram_size(struct radeon_device *rdev, u64 size)
 	man = ttm_manager_type(&rdev->mman.bdev, TTM_PL_VRAM);
 	/* this just adjusts TTM size idea, which sets lpfn to the correct value */
 	man->size = size >> PAGE_SHIFT;
+
+	/* Evict in the background before allocations run out of VRAM */
+	if (radeon_vram_reclaim > 5 && radeon_vram_reclaim <= 100) {
+		high = div_u64(size * radeon_vram_reclaim, 100);
+		ttm_resource_manager_set_watermarks(man,
+			high - div_u64(size * 5, 100), high);
+	}
 }
 
 #if defined(CONFIG_DEBUG_FS)
@@ -54,6 +54,9 @@
 #include <linux/completion.h>
 #include <linux/dma-resv.h>
 #include <uapi/linux/sched/types.h>
+#ifdef __FreeBSD__
+#include <sys/sysctl.h>
+#endif
 
 #include <drm/drm_print.h>
 #include <drm/drm_gem.h>
@@ -76,6 +79,16 @@ int drm_sched_policy = DRM_SCHED_POLICY_FIFO;
 MODULE_PARM_DESC(sched_policy, "Specify the scheduling policy for entities on a run-queue, " __stringify(DRM_SCHED_POLICY_RR) " = Round Robin, " __stringify(DRM_SCHED_POLICY_FIFO) " = FIFO (default).");
 module_param_named(sched_policy, drm_sched_policy, int, 0444);
 
+static bool drm_sched_free_wq;
+
+/**
+ * DOC: sched_free_wq (bool)
+ * Retire finished jobs from the shared unbound workqueue instead of the
+ * scheduler thread, leaving the thread to only push jobs to the hardware.
+ */
+MODULE_PARM_DESC(sched_free_wq, "Free finished jobs from a shared workqueue instead of the scheduler thread (default: false).");
+module_param_named(sched_free_wq, drm_sched_free_wq, bool, 0444);
+
 static __always_inline bool drm_sched_entity_compare_before(struct rb_node *a,
 							    const struct rb_node *b)
 {
@@ -275,7 +288,14 @@ static void drm_sched_job_done(struct drm_sched_job *s_job, int result)
 	dma_fence_get(&s_fence->finished);
 	drm_sched_fence_finished(s_fence, result);
 	dma_fence_put(&s_fence->finished);
-	wake_up_interruptible(&sched->wake_up_worker);
+	if (sched->free_wq) {
+		if (!READ_ONCE(sched->pause_free))
+			queue_work(sched->free_wq, &sched->work_free_job);
+		/* A hardware slot was released */
+		drm_sched_wakeup_if_can_queue(sched);
+	} else {
+		wake_up_interruptible(&sched->wake_up_worker);
+	}
 }
 
 /**
@@ -388,7 +408,7 @@ static void drm_sched_job_timedout(struct work_struct *work)
 
 	sched = container_of(work, struct drm_gpu_scheduler, work_tdr.work);
 
-	/* Protects against concurrent deletion in drm_sched_get_cleanup_job */
+	/* Protects against concurrent deletion in drm_sched_get_cleanup_jobs */
 	spin_lock(&sched->job_list_lock);
 	job = list_first_entry_or_null(&sched->pending_list,
 				       struct drm_sched_job, list);
@@ -440,12 +460,16 @@ void drm_sched_stop(struct drm_gpu_scheduler *sched, struct drm_sched_job *bad)
 	struct drm_sched_job *s_job, *tmp;
 
 	kthread_park(sched->thread);
+	if (sched->free_wq) {
+		WRITE_ONCE(sched->pause_free, true);
+		cancel_work_sync(&sched->work_free_job);
+	}
 
 	/*
 	 * Reinsert back the bad job here - now it's safe as
-	 * drm_sched_get_cleanup_job cannot race against us and release the
+	 * drm_sched_get_cleanup_jobs cannot race against us and release the
 	 * bad job at this point - we parked (waited for) any in progress
-	 * (earlier) cleanups and drm_sched_get_cleanup_job will not be called
+	 * (earlier) cleanups and drm_sched_get_cleanup_jobs will not be called
 	 * now until the scheduler thread is unparked.
 	 */
 	if (bad && bad->sched == sched)
@@ -552,6 +576,10 @@ void drm_sched_start(struct drm_gpu_scheduler *sched, bool full_recovery)
 		spin_unlock(&sched->job_list_lock);
 	}
 
+	if (sched->free_wq) {
+		WRITE_ONCE(sched->pause_free, false);
+		queue_work(sched->free_wq, &sched->work_free_job);
+	}
 	kthread_unpark(sched->thread);
 }
 EXPORT_SYMBOL(drm_sched_start);
@@ -900,28 +928,36 @@ drm_sched_select_entity(struct drm_gpu_scheduler *sched)
 }
 
 /**
- * drm_sched_get_cleanup_job - fetch the next finished job to be destroyed
+ * drm_sched_get_cleanup_jobs - fetch the finished jobs to be destroyed
  *
  * @sched: scheduler instance
+ * @list: list head the finished jobs are moved to
  *
- * Returns the next finished job from the pending list (if there is one)
- * ready for it to be destroyed.
+ * Moves all finished jobs from the head of the pending list to @list in one
+ * go, so that the timeout only needs to be re-armed once per batch. Returns
+ * true if there was at least one job ready for it to be destroyed.
  */
-static struct drm_sched_job *
-drm_sched_get_cleanup_job(struct drm_gpu_scheduler *sched)
+static bool
+drm_sched_get_cleanup_jobs(struct drm_gpu_scheduler *sched,
+			   struct list_head *list)
 {
-	struct drm_sched_job *job, *next;
+	struct drm_sched_job *job, *last = NULL, *next;
+	unsigned int count = 0;
 
 	spin_lock(&sched->job_list_lock);
 
-	job = list_first_entry_or_null(&sched->pending_list,
-				       struct drm_sched_job, list);
+	list_for_each_entry(job, &sched->pending_list, list) {
+		if (!dma_fence_is_signaled(&job->s_fence->finished))
+			break;
+		last = job;
+		count++;
+	}
 
-	if (job && dma_fence_is_signaled(&job->s_fence->finished)) {
-		/* remove job from pending_list */
-		list_del_init(&job->list);
+	if (last) {
+		/* remove the jobs from pending_list */
+		list_cut_position(list, &sched->pending_list, &last->list);
 
-		/* cancel this job's TO timer */
+		/* cancel the TO timer of the first job */
 		cancel_delayed_work(&sched->work_tdr);
 		/* make the scheduled timestamp more accurate */
 		next = list_first_entry_or_null(&sched->pending_list,
@@ -929,17 +965,35 @@ drm_sched_get_cleanup_job(struct drm_gpu_scheduler *sched)
 
 		if (next) {
 			next->s_fence->scheduled.timestamp =
-				dma_fence_timestamp(&job->s_fence->finished);
+				dma_fence_timestamp(&last->s_fence->finished);
 			/* start TO timer for next job */
 			drm_sched_start_timeout(sched);
 		}
-	} else {
-		job = NULL;
+
+		sched->cleanup_batches[min_t(unsigned int, fls(count) - 1,
+					     DRM_SCHED_CLEANUP_BUCKETS - 1)]++;
 	}
 
 	spin_unlock(&sched->job_list_lock);
 
-	return job;
+	return last != NULL;
+}
+
+/**
+ * drm_sched_free_jobs - destroy a batch of finished jobs
+ *
+ * @sched: scheduler instance
+ * @list: jobs returned by drm_sched_get_cleanup_jobs()
+ */
+static void drm_sched_free_jobs(struct drm_gpu_scheduler *sched,
+				struct list_head *list)
+{
+	struct drm_sched_job *job, *tmp;
+
+	list_for_each_entry_safe(job, tmp, list, list) {
+		list_del_init(&job->list);
+		sched->ops->free_job(job);
+	}
 }
 
 /**
@@ -995,6 +1049,27 @@ static bool drm_sched_blocked(struct drm_gpu_scheduler *sched)
 	return false;
 }
 
+/**
+ * drm_sched_free_job_work - retire finished jobs
+ *
+ * @w: free job work
+ *
+ * Used instead of the scheduler thread when the scheduler has a free_wq, so
+ * that freeing jobs never delays pushing new ones to the hardware. The work
+ * runs on an unbound queue, so the jobs of all rings are retired by whatever
+ * worker is idle.
+ */
+static void drm_sched_free_job_work(struct work_struct *w)
+{
+	struct drm_gpu_scheduler *sched =
+		container_of(w, struct drm_gpu_scheduler, work_free_job);
+	LIST_HEAD(list);
+
+	while (!READ_ONCE(sched->pause_free) &&
+	       drm_sched_get_cleanup_jobs(sched, &list))
+		drm_sched_free_jobs(sched, &list);
+}
+
 /**
  * drm_sched_main - main scheduler thread
  *
@@ -1014,16 +1089,19 @@ static int drm_sched_main(void *param)
 		struct drm_sched_fence *s_fence;
 		struct drm_sched_job *sched_job;
 		struct dma_fence *fence;
-		struct drm_sched_job *cleanup_job = NULL;
+		LIST_HEAD(cleanup_list);
+		bool cleanup = false;
 
 		wait_event_interruptible(sched->wake_up_worker,
-					 (cleanup_job = drm_sched_get_cleanup_job(sched)) ||
+					 (!sched->free_wq &&
+					  (cleanup = drm_sched_get_cleanup_jobs(sched,
+										&cleanup_list))) ||
 					 (!drm_sched_blocked(sched) &&
 					  (entity = drm_sched_select_entity(sched))) ||
 					 kthread_should_stop());
 
-		if (cleanup_job)
-			sched->ops->free_job(cleanup_job);
+		if (cleanup)
+			drm_sched_free_jobs(sched, &cleanup_list);
 
 		if (!entity)
 			continue;
@@ -1106,7 +1184,11 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 	spin_lock_init(&sched->job_list_lock);
 	atomic_set(&sched->hw_rq_count, 0);
 	INIT_DELAYED_WORK(&sched->work_tdr, drm_sched_job_timedout);
+	INIT_WORK(&sched->work_free_job, drm_sched_free_job_work);
+	sched->free_wq = drm_sched_free_wq ? system_unbound_wq : NULL;
+	sched->pause_free = false;
 	atomic_set(&sched->_score, 0);
+	memset(sched->cleanup_batches, 0, sizeof(sched->cleanup_batches));
 	atomic64_set(&sched->job_id_count, 0);
 
 	/* Each scheduler will run on a seperate kernel thread */
@@ -1137,6 +1219,10 @@ void drm_sched_fini(struct drm_gpu_scheduler *sched)
 
 	if (sched->thread)
 		kthread_stop(sched->thread);
+	if (sched->free_wq) {
+		WRITE_ONCE(sched->pause_free, true);
+		cancel_work_sync(&sched->work_free_job);
+	}
 
 	for (i = DRM_SCHED_PRIORITY_COUNT - 1; i >= DRM_SCHED_PRIORITY_MIN; i--) {
 		struct drm_sched_rq *rq = &sched->sched_rq[i];
@@ -1163,6 +1249,90 @@ void drm_sched_fini(struct drm_gpu_scheduler *sched)
 }
 EXPORT_SYMBOL(drm_sched_fini);
 
+#ifdef __FreeBSD__
+static int drm_sched_sysctl_jobs_queued(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_gpu_scheduler *sched = arg1;
+	struct drm_sched_entity *entity;
+	uint64_t queued = 0;
+	int i;
+
+	for (i = DRM_SCHED_PRIORITY_MIN; i < DRM_SCHED_PRIORITY_COUNT; i++) {
+		struct drm_sched_rq *rq = &sched->sched_rq[i];
+
+		spin_lock(&rq->lock);
+		list_for_each_entry(entity, &rq->entities, list)
+			queued += spsc_queue_count(&entity->job_queue);
+		spin_unlock(&rq->lock);
+	}
+
+	return sysctl_handle_64(oidp, &queued, 0, req);
+}
+
+static int drm_sched_sysctl_jobs_hw(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_gpu_scheduler *sched = arg1;
+	int count = atomic_read(&sched->hw_rq_count);
+
+	return sysctl_handle_int(oidp, &count, 0, req);
+}
+
+static int drm_sched_sysctl_cleanup_batches(SYSCTL_HANDLER_ARGS)
+{
+	struct drm_gpu_scheduler *sched = arg1;
+	uint64_t hist[DRM_SCHED_CLEANUP_BUCKETS];
+
+	spin_lock(&sched->job_list_lock);
+	memcpy(hist, sched->cleanup_batches, sizeof(hist));
+	spin_unlock(&sched->job_list_lock);
+
+	return SYSCTL_OUT(req, hist, sizeof(hist));
+}
+
+/**
+ * drm_sched_sysctl_init - export the queue depths of a scheduler
+ *
+ * @sched: scheduler instance, must be initialized
+ * @ctx: sysctl context the new nodes are added to
+ * @parent: sysctl node to add the scheduler below
+ *
+ * Adds a node named after the ring holding the number of jobs waiting in
+ * the entity queues, the number of jobs pushed to the hardware and the
+ * log2 histogram of the number of jobs retired per cleanup pass.
+ */
+void drm_sched_sysctl_init(struct drm_gpu_scheduler *sched,
+			   struct sysctl_ctx_list *ctx,
+			   struct sysctl_oid *parent)
+{
+	struct sysctl_oid *node;
+	char name[32], *p;
+
+	/* Ring names such as "gfx_0.0.0" would read as sysctl levels. */
+	strlcpy(name, sched->name, sizeof(name));
+	for (p = name; *p != '\0'; p++) {
+		if (*p == '.')
+			*p = '_';
+	}
+
+	node = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(parent), OID_AUTO, name,
+	    CTLFLAG_RD | CTLFLAG_MPSAFE, NULL, NULL);
+	if (node == NULL)
+		return;
+
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "jobs_queued",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, sched, 0,
+	    drm_sched_sysctl_jobs_queued, "QU", "Jobs waiting in entity queues");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "jobs_hw",
+	    CTLTYPE_INT | CTLFLAG_RD | CTLFLAG_MPSAFE, sched, 0,
+	    drm_sched_sysctl_jobs_hw, "I", "Jobs pushed to the hardware");
+	SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(node), OID_AUTO, "cleanup_batches",
+	    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, sched, 0,
+	    drm_sched_sysctl_cleanup_batches, "QU",
+	    "Cleanup passes retiring 1, 2-3, 4-7, ... 128+ jobs");
+}
+EXPORT_SYMBOL(drm_sched_sysctl_init);
+#endif
+
 /**
  * drm_sched_increase_karma - Update sched_entity guilty flag
  *
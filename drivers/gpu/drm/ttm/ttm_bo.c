@@ -638,6 +638,8 @@ int ttm_mem_evict_first(struct ttm_device *bdev,
 	spin_unlock(&bdev->lru_lock);
 
 	ret = ttm_bo_evict(bo, ctx);
+	if (!ret)
+		ttm_resource_manager_evicted(man, bo);
 	if (locked)
 		ttm_bo_unreserve(bo);
 	else
@@ -974,6 +976,10 @@ int ttm_bo_init_reserved(struct ttm_device *bdev, struct ttm_buffer_object *bo,
 	bo->pin_count = 0;
 	bo->sg = sg;
 	bo->bulk_move = NULL;
+	bo->evicted_from = NULL;
+	/* Don't take the first fault at offset 0 for a sequential one */
+	bo->prefault.next = ~0UL;
+	bo->prefault.window = 0;
 	if (resv)
 		bo->base.resv = resv;
 	else
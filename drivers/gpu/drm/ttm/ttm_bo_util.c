@@ -71,6 +71,41 @@ void ttm_mem_io_free(struct ttm_device *bdev,
 	mem->bus.addr = NULL;
 }
 
+/*
+ * Upper bound for a single copy. The FPU section around it runs with
+ * preemption disabled, so keep it to 64 KiB.
+ */
+#define TTM_MOVE_MEMCPY_PAGES 16
+
+/* Map as many pages as the iterator can hand out in one go */
+static unsigned long ttm_kmap_iter_map_range(struct ttm_kmap_iter *iter,
+					     struct iosys_map *dmap,
+					     pgoff_t i,
+					     unsigned long max_pages)
+{
+	const struct ttm_kmap_iter_ops *ops = iter->ops;
+
+	if (ops->map_local_range)
+		return ops->map_local_range(iter, dmap, i, max_pages);
+
+	ops->map_local(iter, dmap, i);
+	return 1;
+}
+
+static void ttm_kmap_iter_unmap_range(struct ttm_kmap_iter *iter,
+				      struct iosys_map *dmap,
+				      unsigned long num_pages)
+{
+	const struct ttm_kmap_iter_ops *ops = iter->ops;
+
+	if (ops->map_local_range) {
+		if (ops->unmap_local_range)
+			ops->unmap_local_range(iter, dmap, num_pages);
+	} else if (ops->unmap_local) {
+		ops->unmap_local(iter, dmap);
+	}
+}
+
 /**
  * ttm_move_memcpy - Helper to perform a memcpy ttm move operation.
  * @clear: Whether to clear rather than copy.
@@ -79,7 +114,8 @@ void ttm_mem_io_free(struct ttm_device *bdev,
  * @src_iter: A struct ttm_kmap_iter representing the source resource.
  *
  * This function is intended to be able to move out async under a
- * dma-fence if desired.
+ * dma-fence if desired. Iterators implementing map_local_range are copied
+ * in contiguous runs of up to TTM_MOVE_MEMCPY_PAGES pages.
  */
 void ttm_move_memcpy(bool clear,
 		     u32 num_pages,
@@ -89,6 +125,7 @@ void ttm_move_memcpy(bool clear,
 	const struct ttm_kmap_iter_ops *dst_ops = dst_iter->ops;
 	const struct ttm_kmap_iter_ops *src_ops = src_iter->ops;
 	struct iosys_map src_map, dst_map;
+	unsigned long n, dst_n;
 	pgoff_t i;
 
 	/* Single TTM move. NOP */
@@ -97,28 +134,30 @@ void ttm_move_memcpy(bool clear,
 
 	/* Don't move nonexistent data. Clear destination instead. */
 	if (clear) {
-		for (i = 0; i < num_pages; ++i) {
-			dst_ops->map_local(dst_iter, &dst_map, i);
+		for (i = 0; i < num_pages; i += n) {
+			n = ttm_kmap_iter_map_range(dst_iter, &dst_map, i,
+						    min_t(pgoff_t, num_pages - i,
+							  TTM_MOVE_MEMCPY_PAGES));
 			if (dst_map.is_iomem)
-				memset_io(dst_map.vaddr_iomem, 0, PAGE_SIZE);
+				memset_io(dst_map.vaddr_iomem, 0, n * PAGE_SIZE);
 			else
-				memset(dst_map.vaddr, 0, PAGE_SIZE);
-			if (dst_ops->unmap_local)
-				dst_ops->unmap_local(dst_iter, &dst_map);
+				memset(dst_map.vaddr, 0, n * PAGE_SIZE);
+			ttm_kmap_iter_unmap_range(dst_iter, &dst_map, n);
 		}
 		return;
 	}
 
-	for (i = 0; i < num_pages; ++i) {
-		dst_ops->map_local(dst_iter, &dst_map, i);
-		src_ops->map_local(src_iter, &src_map, i);
+	for (i = 0; i < num_pages; i += n) {
+		dst_n = ttm_kmap_iter_map_range(dst_iter, &dst_map, i,
+						min_t(pgoff_t, num_pages - i,
+						      TTM_MOVE_MEMCPY_PAGES));
+		n = ttm_kmap_iter_map_range(src_iter, &src_map, i, dst_n);
 
-		drm_memcpy_from_wc(&dst_map, &src_map, PAGE_SIZE);
+		drm_memcpy_from_wc_streaming(&dst_map, &src_map,
+					     n * PAGE_SIZE);
 
-		if (src_ops->unmap_local)
-			src_ops->unmap_local(src_iter, &src_map);
-		if (dst_ops->unmap_local)
-			dst_ops->unmap_local(dst_iter, &dst_map);
+		ttm_kmap_iter_unmap_range(src_iter, &src_map, n);
+		ttm_kmap_iter_unmap_range(dst_iter, &dst_map, dst_n);
 	}
 }
 EXPORT_SYMBOL(ttm_move_memcpy);
@@ -37,6 +37,30 @@
 
 #include <drm/drm_drv.h>
 #include <drm/drm_managed.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#ifdef __FreeBSD__
+#include <drm/ttm/ttm_sysctl_freebsd.h>
+
+#include <sys/counter.h>
+
+static COUNTER_U64_DEFINE_EARLY(ttm_bo_vm_faults);
+SYSCTL_COUNTER_U64(_hw_ttm, OID_AUTO, vm_faults, CTLFLAG_RD,
+    &ttm_bo_vm_faults, "Page faults on TTM buffer objects");
+
+static COUNTER_U64_DEFINE_EARLY(ttm_bo_vm_superpage_runs);
+SYSCTL_COUNTER_U64(_hw_ttm, OID_AUTO, vm_superpage_runs, CTLFLAG_RD,
+    &ttm_bo_vm_superpage_runs,
+    "Page faults on TTM buffer objects which populated a superpage run, "
+    "mapped with a superpage if the user address is aligned");
+#endif
+
+#include "ttm_module.h"
+
+static atomic_long_t ttm_bo_vm_prefault_faults;
+static atomic_long_t ttm_bo_vm_prefault_sequential;
+static atomic_long_t ttm_bo_vm_prefault_random;
+static atomic_long_t ttm_bo_vm_prefault_pages;
 
 static vm_fault_t ttm_bo_vm_fault_idle(struct ttm_buffer_object *bo,
 				struct vm_fault *vmf)
@@ -81,6 +105,39 @@ static vm_fault_t ttm_bo_vm_fault_idle(struct ttm_buffer_object *bo,
 	return 0;
 }
 
+/*
+ * Pick the number of pages to map for a fault at @page_offset.
+ *
+ * A fault right behind the range mapped last time continues a sequential
+ * stream and doubles the window, up to the size of the BO. Any other fault
+ * halves it, down to the faulting page only. A fresh BO starts with the
+ * @num_prefault the driver asked for, drivers asking for a single page
+ * don't get any prefaulting at all.
+ */
+static pgoff_t ttm_bo_vm_prefault_window(struct ttm_buffer_object *bo,
+					 unsigned long page_offset,
+					 unsigned long page_last,
+					 pgoff_t num_prefault)
+{
+	pgoff_t remaining = page_last - page_offset;
+	pgoff_t window = bo->prefault.window ?: num_prefault;
+	bool sequential = page_offset == bo->prefault.next;
+
+	if (num_prefault <= 1)
+		return 1;
+
+	if (sequential) {
+		window = min_t(pgoff_t, window * 2, PFN_UP(bo->base.size));
+		atomic_long_inc(&ttm_bo_vm_prefault_sequential);
+	} else {
+		window = max_t(pgoff_t, window / 2, 1);
+		atomic_long_inc(&ttm_bo_vm_prefault_random);
+	}
+	bo->prefault.window = window;
+
+	return min(window, remaining);
+}
+
 static unsigned long ttm_bo_io_mem_pfn(struct ttm_buffer_object *bo,
 				       unsigned long page_offset)
 {
@@ -92,6 +149,75 @@ static unsigned long ttm_bo_io_mem_pfn(struct ttm_buffer_object *bo,
 	return (bo->resource->bus.offset >> PAGE_SHIFT) + page_offset;
 }
 
+#ifdef __FreeBSD__
+/*
+ * Try to hand the superpage around @page_offset to the VM at once.
+ *
+ * That is possible when the range is superpage aligned within the mapping,
+ * fully inside it and backed by one pool chunk of at least superpage order
+ * which is physically aligned as well. Only once all pages of the range
+ * were inserted the first one gets marked as superpage. The LinuxKPI vma
+ * addresses are relative to the object, so whether the user address is
+ * aligned too is only known to vm_fault_populate(), which enters a single
+ * PDE if it is and falls back to 4K PTEs otherwise.
+ *
+ * Returns the page offset after the range, or 0 when the fault has to be
+ * mapped with 4K PTEs. Pages inserted before a failure are unbusied and
+ * dropped from the populated range, so that the 4K path can start over
+ * from the faulting page.
+ */
+static unsigned long ttm_bo_vm_superpage(struct vm_area_struct *vma,
+					 struct ttm_tt *ttm,
+					 unsigned long page_offset,
+					 unsigned long address,
+					 unsigned long page_last,
+					 pgprot_t prot)
+{
+	unsigned long size = pagesizes[1];
+	unsigned long start, addr;
+	struct page *page;
+	pgoff_t i, npages, first, count;
+
+	if (size <= PAGE_SIZE)
+		return 0;
+
+	npages = size >> PAGE_SHIFT;
+	addr = address & ~(size - 1);
+	start = page_offset - ((address - addr) >> PAGE_SHIFT);
+	if (addr < vma->vm_start || addr + size > vma->vm_end ||
+	    start > page_offset || start + npages > page_last ||
+	    start + npages > ttm->num_pages)
+		return 0;
+
+	page = ttm->pages[start];
+	if (!page || ttm->orders[start] < ilog2(npages) ||
+	    (page_to_pfn(page) & (npages - 1)) != 0 ||
+	    ttm->pages[start + npages - 1] != page + npages - 1)
+		return 0;
+
+	/* Inserting a page busies it and counts it in the populated range */
+	first = vma->vm_pfn_first;
+	count = vma->vm_pfn_count;
+	for (i = 0; i < npages; ++i) {
+		page[i].oflags &= ~VPO_UNMANAGED;
+		lkpi_vmf_insert_pfn_prot_locked(vma, addr + i * PAGE_SIZE,
+						page_to_pfn(page + i), prot);
+		if (vma->vm_pfn_count != count + i + 1)
+			break;
+	}
+	if (i < npages) {
+		while (i-- > 0)
+			vm_page_xunbusy(page + i);
+		vma->vm_pfn_first = first;
+		vma->vm_pfn_count = count;
+		return 0;
+	}
+
+	page->psind = 1;
+	return start + npages;
+}
+#endif
+
 /**
  * ttm_bo_vm_reserve - Reserve a buffer object in a retryable vm callback
  * @bo: The buffer object
@@ -164,13 +290,14 @@ EXPORT_SYMBOL(ttm_bo_vm_reserve);
  * ttm_bo_vm_fault_reserved - TTM fault helper
  * @vmf: The struct vm_fault given as argument to the fault callback
  * @prot: The page protection to be used for this memory area.
- * @num_prefault: Maximum number of prefault pages. The caller may want to
+ * @num_prefault: Initial number of prefault pages. The caller may want to
  * specify this based on madvice settings and the size of the GPU object
- * backed by the memory.
+ * backed by the memory, 1 disables prefaulting.
  *
  * This function inserts one or more page table entries pointing to the
  * memory backing the buffer object, and then returns a return code
- * instructing the caller to retry the page access.
+ * instructing the caller to retry the page access. The number of entries
+ * adapts to the access pattern seen on the BO.
  *
  * Return:
  *   VM_FAULT_NOPAGE on success or pending signal
@@ -187,6 +314,7 @@ vm_fault_t ttm_bo_vm_fault_reserved(struct vm_fault *vmf,
 	struct ttm_device *bdev = bo->bdev;
 	unsigned long page_offset;
 	unsigned long page_last;
+	unsigned long first;
 	unsigned long pfn;
 	struct ttm_tt *ttm = NULL;
 	struct page *page;
@@ -215,6 +343,9 @@ vm_fault_t ttm_bo_vm_fault_reserved(struct vm_fault *vmf,
 	if (unlikely(page_offset >= PFN_UP(bo->base.size)))
 		return VM_FAULT_SIGBUS;
 
+	num_prefault = ttm_bo_vm_prefault_window(bo, page_offset, page_last,
+						 num_prefault);
+
 	prot = ttm_io_prot(bo, bo->resource, prot);
 	if (!bo->resource->bus.is_iomem) {
 		struct ttm_operation_ctx ctx = {
@@ -242,8 +373,23 @@ vm_fault_t ttm_bo_vm_fault_reserved(struct vm_fault *vmf,
 	 * Speculatively prefault a number of pages. Only error on
 	 * first page.
 	 */
+	first = page_offset;
 #ifdef __FreeBSD__
 	VM_OBJECT_WLOCK(vma->vm_obj);
+	counter_u64_add(ttm_bo_vm_faults, 1);
+	if (ttm) {
+		unsigned long next = ttm_bo_vm_superpage(vma, ttm, page_offset,
+							 address, page_last,
+							 prot);
+
+		if (next) {
+			counter_u64_add(ttm_bo_vm_superpage_runs, 1);
+			VM_OBJECT_WUNLOCK(vma->vm_obj);
+			page_offset = next;
+			ret = VM_FAULT_NOPAGE;
+			goto out;
+		}
+	}
 #endif
 	for (i = 0; i < num_prefault; ++i) {
 		if (bo->resource->bus.is_iomem) {
@@ -295,7 +441,12 @@ vm_fault_t ttm_bo_vm_fault_reserved(struct vm_fault *vmf,
 	}
 #ifdef __FreeBSD__
 	VM_OBJECT_WUNLOCK(vma->vm_obj);
+out:
 #endif
+	bo->prefault.next = page_offset;
+	atomic_long_inc(&ttm_bo_vm_prefault_faults);
+	atomic_long_add(page_offset - first, &ttm_bo_vm_prefault_pages);
+
 	return ret;
 }
 EXPORT_SYMBOL(ttm_bo_vm_fault_reserved);
@@ -513,3 +664,31 @@ int ttm_bo_mmap_obj(struct vm_area_struct *vma, struct ttm_buffer_object *bo)
 	return 0;
 }
 EXPORT_SYMBOL(ttm_bo_mmap_obj);
+
+#ifdef CONFIG_DEBUG_FS
+
+static int ttm_bo_vm_debugfs_prefault_show(struct seq_file *m, void *data)
+{
+	long faults = atomic_long_read(&ttm_bo_vm_prefault_faults);
+	long pages = atomic_long_read(&ttm_bo_vm_prefault_pages);
+
+	seq_printf(m, "faults: %ld\n", faults);
+	seq_printf(m, "sequential: %ld\n",
+		   atomic_long_read(&ttm_bo_vm_prefault_sequential));
+	seq_printf(m, "random: %ld\n",
+		   atomic_long_read(&ttm_bo_vm_prefault_random));
+	seq_printf(m, "pages: %ld\n", pages);
+	seq_printf(m, "pages per fault: %ld\n", faults ? pages / faults : 0);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ttm_bo_vm_debugfs_prefault);
+
+#endif
+
+void ttm_bo_vm_debugfs_init(void)
+{
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("vm_prefault", 0444, ttm_debugfs_root, NULL,
+			    &ttm_bo_vm_debugfs_prefault_fops);
+#endif
+}
@@ -94,6 +94,7 @@ static int ttm_global_init(void)
 
 	ttm_pool_mgr_init(num_pages);
 	ttm_tt_mgr_init(num_pages, num_dma32);
+	ttm_bo_vm_debugfs_init();
 
 	glob->dummy_read_page = alloc_page(__GFP_ZERO | GFP_DMA32);
 
@@ -174,6 +175,78 @@ int ttm_device_swapout(struct ttm_device *bdev, struct ttm_operation_ctx *ctx,
 }
 EXPORT_SYMBOL(ttm_device_swapout);
 
+/* Upper bound for the evictions per reclaim run, requeue when hit */
+#define TTM_DEVICE_RECLAIM_BATCH 64
+/* Back off after an eviction failed, e.g. because everything was busy */
+#define TTM_DEVICE_RECLAIM_DELAY msecs_to_jiffies(10)
+
+/*
+ * Evict from all resource managers above their high watermark until they
+ * are below their low watermark again. The moves are only queued up behind
+ * their fences, busy BOs are left alone and the worker never waits for the
+ * GPU.
+ */
+static void ttm_device_reclaim_work(struct work_struct *work)
+{
+	struct ttm_device *bdev = container_of(work, typeof(*bdev),
+					       reclaim_work.work);
+	struct ttm_operation_ctx ctx = {
+		.interruptible = false,
+		.no_wait_gpu = true,
+	};
+	struct ttm_resource_manager *man;
+	uint64_t usage, start, low, high;
+	unsigned long delay = 0;
+	bool requeue = false;
+	unsigned i, n;
+	int ret;
+
+	for (i = TTM_PL_SYSTEM + 1; i < TTM_NUM_MEM_TYPES; ++i) {
+		man = ttm_manager_type(bdev, i);
+		if (!man || !ttm_resource_manager_used(man))
+			continue;
+
+		spin_lock(&bdev->lru_lock);
+		start = man->usage;
+		low = man->reclaim_low;
+		high = man->reclaim_high;
+		spin_unlock(&bdev->lru_lock);
+		if (!high || start <= high)
+			continue;
+
+		usage = start;
+		ret = 0;
+		for (n = 0; usage > low && n < TTM_DEVICE_RECLAIM_BATCH; ++n) {
+			ret = ttm_mem_evict_first(bdev, man, NULL, &ctx, NULL);
+			if (ret)
+				break;
+			usage = ttm_resource_manager_usage(man);
+		}
+
+		spin_lock(&bdev->lru_lock);
+		++man->reclaim_runs;
+		if (start > usage)
+			man->reclaimed += start - usage;
+		if (ret)
+			++man->reclaim_failed;
+		spin_unlock(&bdev->lru_lock);
+
+		/*
+		 * A failure usually means the BOs at the head of the LRU are
+		 * busy, retrying right away would just hit them again. Give
+		 * them some time, but keep going with the other managers.
+		 */
+		if (usage > low && (ret || n == TTM_DEVICE_RECLAIM_BATCH)) {
+			requeue = true;
+			if (ret)
+				delay = TTM_DEVICE_RECLAIM_DELAY;
+		}
+	}
+
+	if (requeue)
+		queue_delayed_work(bdev->wq, &bdev->reclaim_work, delay);
+}
+
 /**
  * ttm_device_init
  *
@@ -216,6 +289,7 @@ int ttm_device_init(struct ttm_device *bdev, const struct ttm_device_funcs *func
 	}
 
 	bdev->funcs = funcs;
+	INIT_DELAYED_WORK(&bdev->reclaim_work, ttm_device_reclaim_work);
 
 	ttm_sys_man_init(bdev);
 	ttm_pool_init(&bdev->pool, dev, NUMA_NO_NODE, use_dma_alloc, use_dma32);
@@ -243,6 +317,8 @@ void ttm_device_fini(struct ttm_device *bdev)
 	list_del(&bdev->device_list);
 	mutex_unlock(&ttm_global_mutex);
 
+	/* A backed off reclaim run may still wait for its timer */
+	cancel_delayed_work_sync(&bdev->reclaim_work);
 	drain_workqueue(bdev->wq);
 	destroy_workqueue(bdev->wq);
 
@@ -39,5 +39,6 @@ struct ttm_device;
 extern struct dentry *ttm_debugfs_root;
 
 void ttm_sys_man_init(struct ttm_device *bdev);
+void ttm_bo_vm_debugfs_init(void);
 
 #endif /* _TTM_MODULE_H_ */
@@ -46,6 +46,11 @@
 #include <drm/ttm/ttm_bo.h>
 #ifdef __FreeBSD__
 #include <drm/ttm/ttm_sysctl_freebsd.h>
+
+#include <vm/vm.h>
+#include <vm/vm_page.h>
+#include <vm/vm_phys.h>
+#include <vm/vm_pagequeue.h>
 #endif
 
 #include "ttm_module.h"
@@ -59,6 +64,10 @@
 struct ttm_pool_dma {
 	dma_addr_t addr;
 	unsigned long vaddr;
+#ifdef __FreeBSD__
+	struct rb_node node;
+	struct page *page;
+#endif
 };
 
 static unsigned long page_pool_size;
@@ -66,18 +75,158 @@ static unsigned long page_pool_size;
 MODULE_PARM_DESC(page_pool_size, "Number of pages in the WC/UC/DMA pool");
 module_param(page_pool_size, ulong, 0644);
 
+/* Maximum number of pool entries moved under a single pool_type lock */
+#define TTM_POOL_BATCH	32
+
+static unsigned int page_pool_shrink_batch = 8;
+
+MODULE_PARM_DESC(page_pool_shrink_batch, "Number of pool entries the shrinker frees at once (1-32)");
+module_param(page_pool_shrink_batch, uint, 0644);
+
 static atomic_long_t allocated_pages;
 
-static struct ttm_pool_type global_write_combined[MAX_ORDER + 1];
-static struct ttm_pool_type global_uncached[MAX_ORDER + 1];
+/*
+ * The global pools are split per memory domain, so that pages recycled
+ * through them stay on the domain they were allocated from.
+ */
+#ifdef __FreeBSD__
+#define TTM_POOL_DOMAINS	MAXMEMDOM
+#define ttm_pool_num_domains()	vm_ndomains
+#else
+#define TTM_POOL_DOMAINS	1
+#define ttm_pool_num_domains()	1
+#endif
 
-static struct ttm_pool_type global_dma32_write_combined[MAX_ORDER + 1];
-static struct ttm_pool_type global_dma32_uncached[MAX_ORDER + 1];
+static struct ttm_pool_type global_write_combined[TTM_POOL_DOMAINS][MAX_ORDER + 1];
+static struct ttm_pool_type global_uncached[TTM_POOL_DOMAINS][MAX_ORDER + 1];
+
+static struct ttm_pool_type global_dma32_write_combined[TTM_POOL_DOMAINS][MAX_ORDER + 1];
+static struct ttm_pool_type global_dma32_uncached[TTM_POOL_DOMAINS][MAX_ORDER + 1];
 
 static spinlock_t shrinker_lock;
 static struct list_head shrinker_list;
 static struct shrinker mm_shrinker;
 
+#ifdef __FreeBSD__
+/*
+ * struct vm_page has no private field to hang the DMA mapping off, so the
+ * coherent mappings of a pool are kept in a tree indexed by page.
+ */
+static void ttm_pool_dma_insert(struct ttm_pool *pool,
+				struct ttm_pool_dma *dma)
+{
+	struct rb_node **link = &pool->dma_pages.rb_node;
+	struct rb_node *parent = NULL;
+	struct ttm_pool_dma *entry;
+
+	spin_lock(&pool->dma_lock);
+	while (*link) {
+		parent = *link;
+		entry = rb_entry(parent, struct ttm_pool_dma, node);
+		if (dma->page < entry->page)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+	rb_link_node(&dma->node, parent, link);
+	rb_insert_color(&dma->node, &pool->dma_pages);
+	spin_unlock(&pool->dma_lock);
+}
+
+static struct ttm_pool_dma *ttm_pool_dma_lookup(struct ttm_pool *pool,
+						struct page *p)
+{
+	struct ttm_pool_dma *entry;
+	struct rb_node *node;
+
+	spin_lock(&pool->dma_lock);
+	node = pool->dma_pages.rb_node;
+	while (node) {
+		entry = rb_entry(node, struct ttm_pool_dma, node);
+		if (p == entry->page)
+			break;
+		node = p < entry->page ? node->rb_left : node->rb_right;
+	}
+	spin_unlock(&pool->dma_lock);
+
+	return node ? entry : NULL;
+}
+
+static void ttm_pool_dma_remove(struct ttm_pool *pool,
+				struct ttm_pool_dma *dma)
+{
+	spin_lock(&pool->dma_lock);
+	rb_erase(&dma->node, &pool->dma_pages);
+	spin_unlock(&pool->dma_lock);
+}
+
+/*
+ * Allocate physically contiguous pages the device can reach without bounce
+ * buffering, so that the mapping can be kept for as long as the pages live
+ * in the pool. Unlike dma_alloc_coherent() the pages don't belong to the
+ * kernel object and can be inserted into the BO's VM object on fault.
+ */
+static struct page *ttm_pool_alloc_dma_page(struct ttm_pool *pool,
+					    gfp_t gfp_flags,
+					    unsigned int order)
+{
+	vm_paddr_t high = dma_get_mask(pool->dev);
+	int req = VM_ALLOC_NORMAL | VM_ALLOC_WIRED;
+	struct page *p;
+
+	if (gfp_flags & GFP_DMA32)
+		high = min_t(vm_paddr_t, high, BUS_SPACE_MAXADDR_32BIT);
+	if (gfp_flags & __GFP_ZERO)
+		req |= VM_ALLOC_ZERO;
+
+	p = vm_page_alloc_noobj_contig(req, 1UL << order, 0, high, PAGE_SIZE,
+				       0, VM_MEMATTR_DEFAULT);
+	if (!p && !(gfp_flags & __GFP_NORETRY)) {
+		vm_page_reclaim_contig(req, 1UL << order, 0, high, PAGE_SIZE,
+				       0);
+		p = vm_page_alloc_noobj_contig(req, 1UL << order, 0, high,
+					       PAGE_SIZE, 0,
+					       VM_MEMATTR_DEFAULT);
+	}
+
+	return p;
+}
+
+/*
+ * Allocate pages from the given memory domain only, LinuxKPI's alloc_pages()
+ * ignores the node. The pages are wired like the LinuxKPI ones, so that
+ * __free_pages() can release them. Returns NULL when the domain is short.
+ */
+static struct page *ttm_pool_alloc_domain_page(int domain, gfp_t gfp_flags,
+					       unsigned int order)
+{
+	vm_paddr_t high = gfp_flags & GFP_DMA32 ? BUS_SPACE_MAXADDR_32BIT :
+		~(vm_paddr_t)0;
+	int req = VM_ALLOC_NORMAL | VM_ALLOC_WIRED | VM_ALLOC_NODUMP;
+	struct page *p;
+
+	if (gfp_flags & __GFP_ZERO)
+		req |= VM_ALLOC_ZERO;
+
+	if (!order && !(gfp_flags & GFP_DMA32))
+		return vm_page_alloc_noobj_domain(domain, req);
+
+	p = vm_page_alloc_noobj_contig_domain(domain, req, 1UL << order, 0,
+					      high, PAGE_SIZE, 0,
+					      VM_MEMATTR_DEFAULT);
+	if (!p && !(gfp_flags & __GFP_NORETRY)) {
+		vm_page_reclaim_contig_domain(domain, req, 1UL << order, 0,
+					      high, PAGE_SIZE, 0);
+		p = vm_page_alloc_noobj_contig_domain(domain, req,
+						      1UL << order, 0, high,
+						      PAGE_SIZE, 0,
+						      VM_MEMATTR_DEFAULT);
+	}
+
+	return p;
+}
+#endif
+
 /* Allocate pages of size 1 << order with the given gfp_flags */
 static struct page *ttm_pool_alloc_page(struct ttm_pool *pool, gfp_t gfp_flags,
 					unsigned int order)
@@ -96,10 +245,17 @@ static struct page *ttm_pool_alloc_page(struct ttm_pool *pool, gfp_t gfp_flags,
 			__GFP_KSWAPD_RECLAIM;
 
 	if (!pool->use_dma_alloc) {
-		p = alloc_pages_node(pool->nid, gfp_flags, order);
 #ifdef __linux__
+		p = alloc_pages_node(pool->nid, gfp_flags, order);
 		if (p)
 			p->private = order;
+#elif defined(__FreeBSD__)
+		/* Prefer the pool's domain, but don't fail while others have
+		 * memory left.
+		 */
+		p = ttm_pool_alloc_domain_page(pool->domain, gfp_flags, order);
+		if (!p)
+			p = alloc_pages(gfp_flags, order);
 #endif
 		return p;
 	}
@@ -129,8 +285,25 @@ static struct page *ttm_pool_alloc_page(struct ttm_pool *pool, gfp_t gfp_flags,
 	p->private = (unsigned long)dma;
 	return p;
 #elif defined(__FreeBSD__)
-	dma = NULL;
-	panic("ttm_pool.c: use_dma_alloc not implemented");
+	dma = kmalloc(sizeof(*dma), GFP_KERNEL);
+	if (!dma)
+		return NULL;
+
+	p = ttm_pool_alloc_dma_page(pool, gfp_flags, order);
+	if (!p)
+		goto error_free;
+
+	dma->addr = dma_map_page(pool->dev, p, 0, (1ULL << order) * PAGE_SIZE,
+				 DMA_BIDIRECTIONAL);
+	if (dma_mapping_error(pool->dev, dma->addr)) {
+		__free_pages(p, order);
+		goto error_free;
+	}
+
+	dma->vaddr = order;
+	dma->page = p;
+	ttm_pool_dma_insert(pool, dma);
+	return p;
 #endif
 
 error_free:
@@ -145,6 +318,13 @@ static void ttm_pool_free_page(struct ttm_pool *pool, enum ttm_caching caching,
 	unsigned long attr = DMA_ATTR_FORCE_CONTIGUOUS;
 	struct ttm_pool_dma *dma;
 	void *vaddr;
+#ifdef __FreeBSD__
+	unsigned int i;
+
+	/* ttm_bo_vm marks superpage aligned runs, don't leak that */
+	for (i = 0; i < (1 << order); ++i)
+		p[i].psind = 0;
+#endif
 
 #ifdef CONFIG_X86
 	/* We don't care that set_pages_wb is inefficient here. This is only
@@ -168,6 +348,13 @@ static void ttm_pool_free_page(struct ttm_pool *pool, enum ttm_caching caching,
 	dma_free_attrs(pool->dev, (1UL << order) * PAGE_SIZE, vaddr, dma->addr,
 		       attr);
 	kfree(dma);
+#elif defined(__FreeBSD__)
+	dma = ttm_pool_dma_lookup(pool, p);
+	ttm_pool_dma_remove(pool, dma);
+	dma_unmap_page(pool->dev, dma->addr, (1UL << order) * PAGE_SIZE,
+		       DMA_BIDIRECTIONAL);
+	kfree(dma);
+	__free_pages(p, order);
 #endif
 }
 
@@ -204,7 +391,7 @@ static int ttm_pool_map(struct ttm_pool *pool, unsigned int order,
 #ifdef __linux__
 		struct ttm_pool_dma *dma = (void *)p->private;
 #elif defined(__FreeBSD__)
-		struct ttm_pool_dma *dma = NULL;
+		struct ttm_pool_dma *dma = ttm_pool_dma_lookup(pool, p);
 #endif
 
 		addr = dma->addr;
@@ -236,54 +423,94 @@ static void ttm_pool_unmap(struct ttm_pool *pool, dma_addr_t dma_addr,
 		       DMA_BIDIRECTIONAL);
 }
 
-/* Give pages into a specific pool_type */
-static void ttm_pool_type_give(struct ttm_pool_type *pt, struct page *p)
+/* Insert count entries of already cleared pages into a pool_type */
+static void ttm_pool_type_insert(struct ttm_pool_type *pt, struct page **pages,
+				 unsigned int count)
 {
 	unsigned int i, num_pages = 1 << pt->order;
 
-	for (i = 0; i < num_pages; ++i) {
+	spin_lock(&pt->lock);
+	for (i = 0; i < count; ++i) {
 #ifdef __linux__
-		if (PageHighMem(p))
-			clear_highpage(p + i);
-		else
-			clear_page(page_address(p + i));
+		list_add(&pages[i]->lru, &pt->pages);
 #elif defined(__FreeBSD__)
-		pmap_zero_page(p + i);
+		TAILQ_INSERT_HEAD(&pt->pages, pages[i], plinks.q);
 #endif
 	}
+#ifdef __FreeBSD__
+	pt->nr_pages += count * num_pages;
+#endif
+	spin_unlock(&pt->lock);
+	atomic_long_add(count * num_pages, &allocated_pages);
+}
 
-	spin_lock(&pt->lock);
+/* Give count entries of pages into a specific pool_type at once */
+static void ttm_pool_type_give(struct ttm_pool_type *pt, struct page **pages,
+			       unsigned int count)
+{
+	unsigned int i, j, num_pages;
+	struct page *p;
+
+	if (!count)
+		return;
+
+	num_pages = 1 << pt->order;
+	/*
+	 * Clear the pages before taking the lock. On FreeBSD that includes
+	 * the superpage mark ttm_bo_vm may have left on them.
+	 */
+	for (i = 0; i < count; ++i) {
+		p = pages[i];
+		for (j = 0; j < num_pages; ++j) {
 #ifdef __linux__
-	list_add(&p->lru, &pt->pages);
+			if (PageHighMem(p))
+				clear_highpage(p + j);
+			else
+				clear_page(page_address(p + j));
 #elif defined(__FreeBSD__)
-	TAILQ_INSERT_HEAD(&pt->pages, p, plinks.q);
+			p[j].psind = 0;
+			pmap_zero_page(p + j);
 #endif
-	spin_unlock(&pt->lock);
-	atomic_long_add(1 << pt->order, &allocated_pages);
+		}
+	}
+
+	ttm_pool_type_insert(pt, pages, count);
 }
 
-/* Take pages from a specific pool_type, return NULL when nothing available */
-static struct page *ttm_pool_type_take(struct ttm_pool_type *pt)
+/*
+ * Take up to max entries of pages from a specific pool_type at once, return
+ * the number of entries taken.
+ */
+static unsigned int ttm_pool_type_take(struct ttm_pool_type *pt,
+				       struct page **pages, unsigned int max)
 {
+	unsigned int count = 0;
 	struct page *p;
 
 	spin_lock(&pt->lock);
+	while (count < max) {
 #ifdef __linux__
-	p = list_first_entry_or_null(&pt->pages, typeof(*p), lru);
+		p = list_first_entry_or_null(&pt->pages, typeof(*p), lru);
 #elif defined(__FreeBSD__)
-	p = TAILQ_FIRST(&pt->pages);
+		p = TAILQ_FIRST(&pt->pages);
 #endif
-	if (p) {
-		atomic_long_sub(1 << pt->order, &allocated_pages);
+		if (!p)
+			break;
 #ifdef __linux__
 		list_del(&p->lru);
 #elif defined(__FreeBSD__)
 		TAILQ_REMOVE(&pt->pages, p, plinks.q);
 #endif
+		pages[count++] = p;
 	}
+#ifdef __FreeBSD__
+	pt->nr_pages -= count << pt->order;
+#endif
 	spin_unlock(&pt->lock);
+	if (count)
+		atomic_long_sub(count << pt->order, &allocated_pages);
 
-	return p;
+	return count;
 }
 
 /* Initialize and add a pool type to the global shrinker list */
@@ -298,6 +525,10 @@ static void ttm_pool_type_init(struct ttm_pool_type *pt, struct ttm_pool *pool,
 	INIT_LIST_HEAD(&pt->pages);
 #elif defined(__FreeBSD__)
 	TAILQ_INIT(&pt->pages);
+	pt->nr_pages = 0;
+	atomic_long_set(&pt->hits, 0);
+	atomic_long_set(&pt->misses, 0);
+	atomic_long_set(&pt->remote, 0);
 #endif
 
 	spin_lock(&shrinker_lock);
@@ -308,65 +539,270 @@ static void ttm_pool_type_init(struct ttm_pool_type *pt, struct ttm_pool *pool,
 /* Remove a pool_type from the global shrinker list and free all pages */
 static void ttm_pool_type_fini(struct ttm_pool_type *pt)
 {
-	struct page *p;
+	struct page *pages[TTM_POOL_BATCH];
+	unsigned int i, count;
 
 	spin_lock(&shrinker_lock);
 	list_del(&pt->shrinker_list);
 	spin_unlock(&shrinker_lock);
 
-	while ((p = ttm_pool_type_take(pt)))
-		ttm_pool_free_page(pt->pool, pt->caching, pt->order, p);
+	while ((count = ttm_pool_type_take(pt, pages, TTM_POOL_BATCH)))
+		for (i = 0; i < count; ++i)
+			ttm_pool_free_page(pt->pool, pt->caching, pt->order,
+					   pages[i]);
 }
 
-/* Return the pool_type to use for the given caching and order */
-static struct ttm_pool_type *ttm_pool_select_type(struct ttm_pool *pool,
-						  enum ttm_caching caching,
-						  unsigned int order)
+/* Return the memory domain local to the pool's device */
+static inline int ttm_pool_domain(struct ttm_pool *pool)
 {
-	if (pool->use_dma_alloc || pool->nid != NUMA_NO_NODE)
-		return &pool->caching[caching].orders[order];
+#ifdef __FreeBSD__
+	return pool->domain;
+#else
+	return 0;
+#endif
+}
+
+/* Return the memory domain a page was allocated from */
+static inline int ttm_pool_page_domain(struct page *p)
+{
+#ifdef __FreeBSD__
+	return vm_page_domain(p);
+#else
+	return 0;
+#endif
+}
 
 #ifdef CONFIG_X86
+/* Return the global pool_type for the given caching, order and domain */
+static struct ttm_pool_type *ttm_pool_global_type(enum ttm_caching caching,
+						  unsigned int order,
+						  int domain, bool dma32)
+{
 	switch (caching) {
 	case ttm_write_combined:
-		if (pool->use_dma32)
-			return &global_dma32_write_combined[order];
+		if (dma32)
+			return &global_dma32_write_combined[domain][order];
 
-		return &global_write_combined[order];
+		return &global_write_combined[domain][order];
 	case ttm_uncached:
-		if (pool->use_dma32)
-			return &global_dma32_uncached[order];
+		if (dma32)
+			return &global_dma32_uncached[domain][order];
 
-		return &global_uncached[order];
+		return &global_uncached[domain][order];
 	default:
 		break;
 	}
+
+	return NULL;
+}
 #endif
 
+/* Return the pool_type to use for the given caching, order and domain */
+static struct ttm_pool_type *ttm_pool_select_domain_type(struct ttm_pool *pool,
+							 enum ttm_caching caching,
+							 unsigned int order,
+							 int domain)
+{
+	if (pool->use_dma_alloc || pool->nid != NUMA_NO_NODE)
+		return &pool->caching[caching].orders[order];
+
+#ifdef CONFIG_X86
+	return ttm_pool_global_type(caching, order, domain, pool->use_dma32);
+#else
 	return NULL;
+#endif
 }
 
-/* Free pages using the global shrinker list */
-static unsigned int ttm_pool_shrink(void)
+/* Return the pool_type to use for the given caching and order */
+static struct ttm_pool_type *ttm_pool_select_type(struct ttm_pool *pool,
+						  enum ttm_caching caching,
+						  unsigned int order)
+{
+	return ttm_pool_select_domain_type(pool, caching, order,
+					   ttm_pool_domain(pool));
+}
+
+#ifdef __FreeBSD__
+/*
+ * Take pages from the pool_type of another domain when the local one is
+ * empty. On success *ppt is updated to the pool_type the pages came from.
+ */
+static unsigned int ttm_pool_take_remote(struct ttm_pool *pool,
+					 enum ttm_caching caching,
+					 unsigned int order,
+					 struct ttm_pool_type **ppt,
+					 struct page **pages, unsigned int max)
 {
 	struct ttm_pool_type *pt;
-	unsigned int num_pages;
+	unsigned int count;
+	int domain;
+
+	for (domain = 0; domain < ttm_pool_num_domains(); ++domain) {
+		pt = ttm_pool_select_domain_type(pool, caching, order, domain);
+		/* Device private pool types are shared by all domains */
+		if (!pt || pt == *ppt)
+			continue;
+
+		count = ttm_pool_type_take(pt, pages, max);
+		if (count) {
+			*ppt = pt;
+			return count;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+#if defined(__FreeBSD__) && defined(CONFIG_X86)
+/*
+ * Background prefill of the global WC/UC pools.
+ *
+ * Converting fresh pages to WC/UC and clearing them is costly, so a worker
+ * keeps up to hw.ttm.pool_prefill_high entries of each order up to
+ * hw.ttm.pool_prefill_order in the global pools which have been used. It is
+ * kicked once a pool type drops below hw.ttm.pool_prefill_low entries and
+ * backs off while the system is short of memory or the pools are at
+ * page_pool_size. Pages are cleared while still write-back, before their
+ * caching is changed, and come from the domain of the pool they refill.
+ */
+static unsigned int ttm_pool_prefill_low;
+SYSCTL_UINT(_hw_ttm, OID_AUTO, pool_prefill_low, CTLFLAG_RWTUN,
+    &ttm_pool_prefill_low, 0,
+    "Refill the global WC/UC pools below this many entries per order");
+
+static unsigned int ttm_pool_prefill_high;
+SYSCTL_UINT(_hw_ttm, OID_AUTO, pool_prefill_high, CTLFLAG_RWTUN,
+    &ttm_pool_prefill_high, 0,
+    "Refill the global WC/UC pools up to this many entries per order");
+
+static unsigned int ttm_pool_prefill_order = MAX_ORDER;
+SYSCTL_UINT(_hw_ttm, OID_AUTO, pool_prefill_order, CTLFLAG_RWTUN,
+    &ttm_pool_prefill_order, 0,
+    "Highest order the global WC/UC pools are refilled for");
+
+static struct work_struct ttm_pool_prefill_work;
+
+/*
+ * Allocate, clear and convert up to count entries for the pool_type of the
+ * given domain
+ */
+static unsigned int ttm_pool_prefill_type(struct ttm_pool_type *pt, int domain,
+					  gfp_t gfp_flags, unsigned int count)
+{
+	struct page *pages[TTM_POOL_BATCH];
+	unsigned int n = 0;
 	struct page *p;
+	int r;
+
+	while (n < count) {
+		p = ttm_pool_alloc_domain_page(domain, gfp_flags, pt->order);
+		if (!p)
+			break;
+
+		if (pt->caching == ttm_write_combined)
+			r = set_pages_wc(p, 1 << pt->order);
+		else
+			r = set_pages_uc(p, 1 << pt->order);
+		if (r) {
+			__free_pages(p, pt->order);
+			break;
+		}
+		pages[n++] = p;
+	}
+
+	if (n)
+		ttm_pool_type_insert(pt, pages, n);
+
+	return n;
+}
+
+/*
+ * Refill a global pool_type up to the high watermark, return false when the
+ * worker should back off.
+ */
+static bool ttm_pool_prefill_one(struct ttm_pool_type *pt, int domain,
+				 gfp_t gfp_flags)
+{
+	unsigned int n, entries, high = READ_ONCE(ttm_pool_prefill_high);
+
+	/* Leave pools nobody allocates from alone */
+	if (!atomic_long_read(&pt->hits) && !atomic_long_read(&pt->misses))
+		return true;
+
+	gfp_flags |= __GFP_ZERO | __GFP_NORETRY | __GFP_NOWARN;
+	entries = READ_ONCE(pt->nr_pages) >> pt->order;
+	while (entries < high) {
+		if (vm_page_count_severe() ||
+		    atomic_long_read(&allocated_pages) >= page_pool_size)
+			return false;
+
+		n = ttm_pool_prefill_type(pt, domain, gfp_flags,
+					  min(high - entries, TTM_POOL_BATCH));
+		/* This domain is short, the others may still have memory */
+		if (!n)
+			return true;
+
+		entries += n;
+		cond_resched();
+	}
+
+	return true;
+}
+
+static void ttm_pool_prefill_work_func(struct work_struct *work)
+{
+	unsigned int d, order, max_order;
+
+	max_order = min_t(unsigned int, MAX_ORDER,
+			  READ_ONCE(ttm_pool_prefill_order));
+	for (d = 0; d < ttm_pool_num_domains(); ++d) {
+		for (order = 0; order <= max_order; ++order) {
+			if (!ttm_pool_prefill_one(&global_write_combined[d][order],
+						  d, GFP_HIGHUSER) ||
+			    !ttm_pool_prefill_one(&global_uncached[d][order],
+						  d, GFP_HIGHUSER) ||
+			    !ttm_pool_prefill_one(&global_dma32_write_combined[d][order],
+						  d, GFP_DMA32) ||
+			    !ttm_pool_prefill_one(&global_dma32_uncached[d][order],
+						  d, GFP_DMA32))
+				return;
+		}
+	}
+}
+
+/* Kick the prefill worker when a global pool_type runs low */
+static void ttm_pool_prefill_check(struct ttm_pool_type *pt)
+{
+	if (pt->pool || pt->caching == ttm_cached ||
+	    pt->order > READ_ONCE(ttm_pool_prefill_order))
+		return;
+
+	if ((READ_ONCE(pt->nr_pages) >> pt->order) <
+	    READ_ONCE(ttm_pool_prefill_low))
+		schedule_work(&ttm_pool_prefill_work);
+}
+#endif
+
+/* Free a batch of pages using the global shrinker list */
+static unsigned int ttm_pool_shrink(void)
+{
+	struct page *pages[TTM_POOL_BATCH];
+	struct ttm_pool_type *pt;
+	unsigned int i, count;
 
 	spin_lock(&shrinker_lock);
 	pt = list_first_entry(&shrinker_list, typeof(*pt), shrinker_list);
 	list_move_tail(&pt->shrinker_list, &shrinker_list);
 	spin_unlock(&shrinker_lock);
 
-	p = ttm_pool_type_take(pt);
-	if (p) {
-		ttm_pool_free_page(pt->pool, pt->caching, pt->order, p);
-		num_pages = 1 << pt->order;
-	} else {
-		num_pages = 0;
-	}
+	count = ttm_pool_type_take(pt, pages,
+				   clamp(READ_ONCE(page_pool_shrink_batch),
+					 1U, TTM_POOL_BATCH));
+	for (i = 0; i < count; ++i)
+		ttm_pool_free_page(pt->pool, pt->caching, pt->order, pages[i]);
 
-	return num_pages;
+	return count << pt->order;
 }
 
 #ifdef __linux__
@@ -437,8 +873,10 @@ static void ttm_pool_free_range(struct ttm_pool *pool, struct ttm_tt *tt,
 				enum ttm_caching caching,
 				pgoff_t start_page, pgoff_t end_page)
 {
+	struct ttm_pool_type *batch_pt = NULL;
+	struct page *batch[TTM_POOL_BATCH];
 	struct page **pages = tt->pages;
-	unsigned int order;
+	unsigned int order, count = 0;
 	pgoff_t i, nr;
 
 	for (i = start_page; i < end_page; i += nr, pages += nr) {
@@ -453,12 +891,22 @@ static void ttm_pool_free_range(struct ttm_pool *pool, struct ttm_tt *tt,
 		if (tt->dma_address)
 			ttm_pool_unmap(pool, tt->dma_address[i], nr);
 
-		pt = ttm_pool_select_type(pool, caching, order);
-		if (pt)
-			ttm_pool_type_give(pt, *pages);
-		else
+		pt = ttm_pool_select_domain_type(pool, caching, order,
+						 ttm_pool_page_domain(*pages));
+		if (!pt) {
 			ttm_pool_free_page(pool, caching, order, *pages);
+			continue;
+		}
+
+		/* Hand the pages back in batches of the same pool_type */
+		if (pt != batch_pt || count == TTM_POOL_BATCH) {
+			ttm_pool_type_give(batch_pt, batch, count);
+			batch_pt = pt;
+			count = 0;
+		}
+		batch[count++] = *pages;
 	}
+	ttm_pool_type_give(batch_pt, batch, count);
 }
 
 /**
@@ -484,9 +932,13 @@ int ttm_pool_alloc(struct ttm_pool *pool, struct ttm_tt *tt,
 	unsigned int *orders = tt->orders;
 #endif
 	enum ttm_caching page_caching;
+#ifdef __FreeBSD__
+	bool remote = false;
+#endif
+	struct page *batch[TTM_POOL_BATCH];
 	gfp_t gfp_flags = GFP_USER;
 	pgoff_t caching_divide;
-	unsigned int order;
+	unsigned int order, i, n;
 	struct page *p;
 	int r;
 
@@ -508,40 +960,83 @@ int ttm_pool_alloc(struct ttm_pool *pool, struct ttm_tt *tt,
 	     num_pages;
 	     order = min_t(unsigned int, order, __fls(num_pages))) {
 		struct ttm_pool_type *pt;
+#ifdef __FreeBSD__
+		struct ttm_pool_type *local;
+#endif
 
 		page_caching = tt->caching;
 		pt = ttm_pool_select_type(pool, tt->caching, order);
-		p = pt ? ttm_pool_type_take(pt) : NULL;
-		if (p) {
+		n = pt ? ttm_pool_type_take(pt, batch,
+					    min_t(pgoff_t, num_pages >> order,
+						  TTM_POOL_BATCH)) : 0;
+#ifdef __FreeBSD__
+		/*
+		 * Only recycle pages of remote domains once the local domain
+		 * is short of free pages or we failed to allocate new ones.
+		 */
+		local = pt;
+		if (!n && pt &&
+		    (remote || vm_page_count_min_domain(ttm_pool_domain(pool))))
+			n = ttm_pool_take_remote(pool, tt->caching, order, &pt,
+						 batch,
+						 min_t(pgoff_t, num_pages >> order,
+						       TTM_POOL_BATCH));
+#endif
+		p = NULL;
+		if (n) {
 			r = ttm_pool_apply_caching(caching, pages,
 						   tt->caching);
-			if (r)
+			if (r) {
+				p = batch[0];
+				ttm_pool_type_give(pt, batch + 1, n - 1);
 				goto error_free_page;
+			}
 
 			caching = pages;
 			do {
+				for (i = 0; i < n; ++i) {
+					p = batch[i];
 #ifdef __linux__
-				r = ttm_pool_page_allocated(pool, order, p,
-							    &dma_addr,
-							    &num_pages,
-							    &pages);
+					r = ttm_pool_page_allocated(pool, order,
+								    p, &dma_addr,
+								    &num_pages,
+								    &pages);
 #elif defined(__FreeBSD__)
-				r = ttm_pool_page_allocated(pool, order, p,
-							    &dma_addr,
-							    &num_pages,
-							    &pages,
-							    &orders);
+					r = ttm_pool_page_allocated(pool, order,
+								    p, &dma_addr,
+								    &num_pages,
+								    &pages,
+								    &orders);
+#endif
+					if (r) {
+						ttm_pool_type_give(pt,
+								   batch + i + 1,
+								   n - i - 1);
+						goto error_free_page;
+					}
+					caching = pages;
+				}
+#ifdef __FreeBSD__
+				atomic_long_add(n, pt == local ? &pt->hits :
+						&pt->remote);
 #endif
-				if (r)
-					goto error_free_page;
-
-				caching = pages;
 				if (num_pages < (1 << order))
 					break;
 
-				p = ttm_pool_type_take(pt);
-			} while (p);
+				n = ttm_pool_type_take(pt, batch,
+						       min_t(pgoff_t,
+							     num_pages >> order,
+							     TTM_POOL_BATCH));
+			} while (n);
+
+			/* The pool ran dry before the request was satisfied */
+			if (!n)
+				p = NULL;
 		}
+#if defined(__FreeBSD__) && defined(CONFIG_X86)
+		if (local)
+			ttm_pool_prefill_check(local);
+#endif
 
 		page_caching = ttm_cached;
 		while (num_pages >= (1 << order) &&
@@ -563,11 +1058,21 @@ int ttm_pool_alloc(struct ttm_pool *pool, struct ttm_tt *tt,
 #endif
 			if (r)
 				goto error_free_page;
+#ifdef __FreeBSD__
+			if (local)
+				atomic_long_inc(&local->misses);
+#endif
 			if (PageHighMem(p))
 				caching = pages;
 		}
 
 		if (!p) {
+#ifdef __FreeBSD__
+			if (local && !remote) {
+				remote = true;
+				continue;
+			}
+#endif
 			if (order) {
 				--order;
 				continue;
@@ -628,6 +1133,9 @@ void ttm_pool_init(struct ttm_pool *pool, struct device *dev,
 		   int nid, bool use_dma_alloc, bool use_dma32)
 {
 	unsigned int i, j;
+#ifdef __FreeBSD__
+	int domain;
+#endif
 
 	WARN_ON(!dev && use_dma_alloc);
 
@@ -635,6 +1143,16 @@ void ttm_pool_init(struct ttm_pool *pool, struct device *dev,
 	pool->nid = nid;
 	pool->use_dma_alloc = use_dma_alloc;
 	pool->use_dma32 = use_dma32;
+#ifdef __FreeBSD__
+	spin_lock_init(&pool->dma_lock);
+	pool->dma_pages = RB_ROOT;
+
+	if (nid != NUMA_NO_NODE)
+		domain = nid;
+	else if (!dev || bus_get_domain(dev->bsddev, &domain) != 0)
+		domain = 0;
+	pool->domain = domain >= 0 && domain < vm_ndomains ? domain : 0;
+#endif
 
 	if (use_dma_alloc || nid != NUMA_NO_NODE) {
 		for (i = 0; i < TTM_NUM_CACHING_TYPES; ++i)
@@ -662,6 +1180,9 @@ void ttm_pool_fini(struct ttm_pool *pool)
 			for (j = 0; j <= MAX_ORDER; ++j)
 				ttm_pool_type_fini(&pool->caching[i].orders[j]);
 	}
+#ifdef __FreeBSD__
+	WARN_ON(!RB_EMPTY_ROOT(&pool->dma_pages));
+#endif
 
 	/* We removed the pool types from the LRU, but we need to also make sure
 	 * that no shrinker is concurrently freeing pages from the pool.
@@ -746,20 +1267,55 @@ static void ttm_pool_debugfs_footer(struct seq_file *m)
 		   atomic_long_read(&allocated_pages), page_pool_size);
 }
 
+#ifdef __FreeBSD__
+/* Dump the hit/miss counters of the global pools of a domain */
+static void ttm_pool_debugfs_domain_stats(unsigned int domain,
+					  struct seq_file *m)
+{
+	struct ttm_pool_type *pts[] = {
+		global_write_combined[domain],
+		global_uncached[domain],
+		global_dma32_write_combined[domain],
+		global_dma32_uncached[domain],
+	};
+	unsigned long hits = 0, misses = 0, remote = 0;
+	unsigned int i, j;
+
+	for (i = 0; i < ARRAY_SIZE(pts); ++i) {
+		for (j = 0; j <= MAX_ORDER; ++j) {
+			hits += atomic_long_read(&pts[i][j].hits);
+			misses += atomic_long_read(&pts[i][j].misses);
+			remote += atomic_long_read(&pts[i][j].remote);
+		}
+	}
+	seq_printf(m, "hits\t: %lu, misses: %lu, remote: %lu\n",
+		   hits, misses, remote);
+}
+#endif
+
 /* Dump the information for the global pools */
 static int ttm_pool_debugfs_globals_show(struct seq_file *m, void *data)
 {
+	unsigned int d;
+
 	ttm_pool_debugfs_header(m);
 
 	spin_lock(&shrinker_lock);
-	seq_puts(m, "wc\t:");
-	ttm_pool_debugfs_orders(global_write_combined, m);
-	seq_puts(m, "uc\t:");
-	ttm_pool_debugfs_orders(global_uncached, m);
-	seq_puts(m, "wc 32\t:");
-	ttm_pool_debugfs_orders(global_dma32_write_combined, m);
-	seq_puts(m, "uc 32\t:");
-	ttm_pool_debugfs_orders(global_dma32_uncached, m);
+	for (d = 0; d < ttm_pool_num_domains(); ++d) {
+		if (ttm_pool_num_domains() > 1)
+			seq_printf(m, "domain %u:\n", d);
+		seq_puts(m, "wc\t:");
+		ttm_pool_debugfs_orders(global_write_combined[d], m);
+		seq_puts(m, "uc\t:");
+		ttm_pool_debugfs_orders(global_uncached[d], m);
+		seq_puts(m, "wc 32\t:");
+		ttm_pool_debugfs_orders(global_dma32_write_combined[d], m);
+		seq_puts(m, "uc 32\t:");
+		ttm_pool_debugfs_orders(global_dma32_uncached[d], m);
+#ifdef __FreeBSD__
+		ttm_pool_debugfs_domain_stats(d, m);
+#endif
+	}
 	spin_unlock(&shrinker_lock);
 
 	ttm_pool_debugfs_footer(m);
@@ -824,6 +1380,139 @@ static int ttm_pool_debugfs_shrink_show(struct seq_file *m, void *data)
 }
 DEFINE_SHOW_ATTRIBUTE(ttm_pool_debugfs_shrink);
 
+#ifdef __FreeBSD__
+/* Dump the percentage of allocations served from the pool types */
+static void ttm_pool_debugfs_hit_rate(struct ttm_pool_type *pt,
+				      struct seq_file *m)
+{
+	unsigned long hits, misses;
+	unsigned int i;
+
+	for (i = 0; i <= MAX_ORDER; ++i) {
+		hits = atomic_long_read(&pt[i].hits);
+		misses = atomic_long_read(&pt[i].misses);
+		if (hits + misses)
+			seq_printf(m, " %7lu%%", hits * 100 / (hits + misses));
+		else
+			seq_puts(m, "        -");
+	}
+	seq_puts(m, "\n");
+}
+
+/* Dump the hit rate of the global pools and the coherent DMA pools */
+static int ttm_pool_debugfs_hit_rate_show(struct seq_file *m, void *data)
+{
+	struct ttm_pool_type *pt;
+	struct ttm_pool *pool;
+	unsigned int i, d;
+
+	ttm_pool_debugfs_header(m);
+
+	spin_lock(&shrinker_lock);
+	for (d = 0; d < ttm_pool_num_domains(); ++d) {
+		if (ttm_pool_num_domains() > 1)
+			seq_printf(m, "domain %u:\n", d);
+		seq_puts(m, "wc\t:");
+		ttm_pool_debugfs_hit_rate(global_write_combined[d], m);
+		seq_puts(m, "uc\t:");
+		ttm_pool_debugfs_hit_rate(global_uncached[d], m);
+		seq_puts(m, "wc 32\t:");
+		ttm_pool_debugfs_hit_rate(global_dma32_write_combined[d], m);
+		seq_puts(m, "uc 32\t:");
+		ttm_pool_debugfs_hit_rate(global_dma32_uncached[d], m);
+	}
+
+	/* Print each pool with coherent DMA pools once */
+	list_for_each_entry(pt, &shrinker_list, shrinker_list) {
+		pool = pt->pool;
+		if (!pool || !pool->use_dma_alloc ||
+		    pt != &pool->caching[ttm_cached].orders[0])
+			continue;
+
+		seq_printf(m, "\n%s:\n", dev_name(pool->dev));
+		for (i = 0; i < TTM_NUM_CACHING_TYPES; ++i) {
+			seq_puts(m, "DMA ");
+			switch (i) {
+			case ttm_cached:
+				seq_puts(m, "\t:");
+				break;
+			case ttm_write_combined:
+				seq_puts(m, "wc\t:");
+				break;
+			case ttm_uncached:
+				seq_puts(m, "uc\t:");
+				break;
+			}
+			ttm_pool_debugfs_hit_rate(pool->caching[i].orders, m);
+		}
+	}
+	spin_unlock(&shrinker_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ttm_pool_debugfs_hit_rate);
+#endif
+
+#endif
+
+#ifdef __FreeBSD__
+static int ttm_pool_sysctl_pages(SYSCTL_HANDLER_ARGS)
+{
+	struct ttm_pool *pool = arg1;
+	struct ttm_pool_type *pt;
+	int d, domains = 1;
+	uint64_t pages = 0;
+	unsigned int i;
+
+	/* The global pools are split per domain, device private ones aren't */
+	if (!pool->use_dma_alloc && pool->nid == NUMA_NO_NODE)
+		domains = ttm_pool_num_domains();
+
+	for (d = 0; d < domains; ++d) {
+		for (i = 0; i <= MAX_ORDER; ++i) {
+			pt = ttm_pool_select_domain_type(pool, arg2, i, d);
+			if (pt)
+				pages += READ_ONCE(pt->nr_pages);
+		}
+	}
+
+	return sysctl_handle_64(oidp, &pages, 0, req);
+}
+
+/**
+ * ttm_pool_sysctl_init - Export the pool sizes through sysctl
+ *
+ * @pool: the pool to export
+ * @ctx: sysctl context the new nodes are added to
+ * @parent: sysctl node to add the "ttm_pool" node below
+ *
+ * Reports the pages held for reuse per caching type. Pools which are shared
+ * between devices, like the global write-combined one, are reported as a
+ * whole.
+ */
+void ttm_pool_sysctl_init(struct ttm_pool *pool, struct sysctl_ctx_list *ctx,
+			  struct sysctl_oid *parent)
+{
+	static const char * const names[TTM_NUM_CACHING_TYPES] = {
+		[ttm_cached] = "cached",
+		[ttm_write_combined] = "write_combined",
+		[ttm_uncached] = "uncached",
+	};
+	struct sysctl_oid *node;
+	unsigned int i;
+
+	node = SYSCTL_ADD_NODE(ctx, SYSCTL_CHILDREN(parent), OID_AUTO,
+	    "ttm_pool", CTLFLAG_RD | CTLFLAG_MPSAFE, NULL,
+	    "Pages held in the TTM page pools");
+	if (node == NULL)
+		return;
+
+	for (i = 0; i < TTM_NUM_CACHING_TYPES; ++i)
+		SYSCTL_ADD_PROC(ctx, SYSCTL_CHILDREN(node), OID_AUTO, names[i],
+		    CTLTYPE_U64 | CTLFLAG_RD | CTLFLAG_MPSAFE, pool, i,
+		    ttm_pool_sysctl_pages, "QU", NULL);
+}
+EXPORT_SYMBOL(ttm_pool_sysctl_init);
 #endif
 
 /**
@@ -835,23 +1524,29 @@ DEFINE_SHOW_ATTRIBUTE(ttm_pool_debugfs_shrink);
  */
 int ttm_pool_mgr_init(unsigned long num_pages)
 {
-	unsigned int i;
+	unsigned int i, d;
 
 	if (!page_pool_size)
 		page_pool_size = num_pages;
 
 	spin_lock_init(&shrinker_lock);
 	INIT_LIST_HEAD(&shrinker_list);
+#if defined(__FreeBSD__) && defined(CONFIG_X86)
+	INIT_WORK(&ttm_pool_prefill_work, ttm_pool_prefill_work_func);
+#endif
 
-	for (i = 0; i <= MAX_ORDER; ++i) {
-		ttm_pool_type_init(&global_write_combined[i], NULL,
-				   ttm_write_combined, i);
-		ttm_pool_type_init(&global_uncached[i], NULL, ttm_uncached, i);
-
-		ttm_pool_type_init(&global_dma32_write_combined[i], NULL,
-				   ttm_write_combined, i);
-		ttm_pool_type_init(&global_dma32_uncached[i], NULL,
-				   ttm_uncached, i);
+	for (d = 0; d < ttm_pool_num_domains(); ++d) {
+		for (i = 0; i <= MAX_ORDER; ++i) {
+			ttm_pool_type_init(&global_write_combined[d][i], NULL,
+					   ttm_write_combined, i);
+			ttm_pool_type_init(&global_uncached[d][i], NULL,
+					   ttm_uncached, i);
+
+			ttm_pool_type_init(&global_dma32_write_combined[d][i],
+					   NULL, ttm_write_combined, i);
+			ttm_pool_type_init(&global_dma32_uncached[d][i], NULL,
+					   ttm_uncached, i);
+		}
 	}
 
 #ifdef CONFIG_DEBUG_FS
@@ -859,6 +1554,10 @@ int ttm_pool_mgr_init(unsigned long num_pages)
 			    &ttm_pool_debugfs_globals_fops);
 	debugfs_create_file("page_pool_shrink", 0400, ttm_debugfs_root, NULL,
 			    &ttm_pool_debugfs_shrink_fops);
+#ifdef __FreeBSD__
+	debugfs_create_file("page_pool_hit_rate", 0444, ttm_debugfs_root, NULL,
+			    &ttm_pool_debugfs_hit_rate_fops);
+#endif
 #endif
 
 	mm_shrinker.count_objects = ttm_pool_shrinker_count;
@@ -874,14 +1573,20 @@ int ttm_pool_mgr_init(unsigned long num_pages)
  */
 void ttm_pool_mgr_fini(void)
 {
-	unsigned int i;
+	unsigned int i, d;
 
-	for (i = 0; i <= MAX_ORDER; ++i) {
-		ttm_pool_type_fini(&global_write_combined[i]);
-		ttm_pool_type_fini(&global_uncached[i]);
+#if defined(__FreeBSD__) && defined(CONFIG_X86)
+	cancel_work_sync(&ttm_pool_prefill_work);
+#endif
 
-		ttm_pool_type_fini(&global_dma32_write_combined[i]);
-		ttm_pool_type_fini(&global_dma32_uncached[i]);
+	for (d = 0; d < ttm_pool_num_domains(); ++d) {
+		for (i = 0; i <= MAX_ORDER; ++i) {
+			ttm_pool_type_fini(&global_write_combined[d][i]);
+			ttm_pool_type_fini(&global_uncached[d][i]);
+
+			ttm_pool_type_fini(&global_dma32_write_combined[d][i]);
+			ttm_pool_type_fini(&global_dma32_uncached[d][i]);
+		}
 	}
 
 	unregister_shrinker(&mm_shrinker);
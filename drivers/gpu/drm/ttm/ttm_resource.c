@@ -24,12 +24,18 @@
 
 #include <linux/iosys-map.h>
 #include <linux/io-mapping.h>
+#include <linux/module.h>
 #include <linux/scatterlist.h>
 
 #include <drm/ttm/ttm_bo.h>
 #include <drm/ttm/ttm_placement.h>
 #include <drm/ttm/ttm_resource.h>
 
+static bool ttm_lru_gens;
+
+MODULE_PARM_DESC(lru_gens, "Use the generational LRU for eviction");
+module_param_named(lru_gens, ttm_lru_gens, bool, 0444);
+
 /**
  * ttm_lru_bulk_move_init - initialize a bulk move structure
  * @bulk: the structure to init
@@ -67,6 +73,15 @@ void ttm_lru_bulk_move_tail(struct ttm_lru_bulk_move *bulk)
 			dma_resv_assert_held(pos->last->bo->base.resv);
 
 			man = ttm_manager_type(pos->first->bo->bdev, i);
+			if (man->lru_gens) {
+				struct ttm_resource *res = pos->first;
+
+				for (;; res = list_next_entry(res, lru)) {
+					res->lru_gen = man->lru_gen;
+					if (res == pos->last)
+						break;
+				}
+			}
 			list_bulk_move_tail(&man->lru[j], &pos->first->lru,
 					    &pos->last->lru);
 		}
@@ -150,6 +165,9 @@ void ttm_resource_move_to_lru_tail(struct ttm_resource *res)
 
 	lockdep_assert_held(&bo->bdev->lru_lock);
 
+	/* Being used makes the resource part of the youngest generation */
+	res->lru_gen = ttm_manager_type(bdev, res->mem_type)->lru_gen;
+
 	if (bo->pin_count) {
 		list_move_tail(&res->lru, &bdev->pinned);
 
@@ -192,11 +210,21 @@ void ttm_resource_init(struct ttm_buffer_object *bo,
 
 	man = ttm_manager_type(bo->bdev, place->mem_type);
 	spin_lock(&bo->bdev->lru_lock);
+	res->lru_gen = man->lru_gen;
+	res->lru_tier = 0;
+	if (bo->evicted_from == man) {
+		/* Evicted and back again, protect it a bit longer this time */
+		++man->refaults;
+		res->lru_tier = 1;
+		bo->evicted_from = NULL;
+	}
 	if (bo->pin_count)
 		list_add_tail(&res->lru, &bo->bdev->pinned);
 	else
 		list_add_tail(&res->lru, &man->lru[bo->priority]);
 	man->usage += res->size;
+	if (man->reclaim_high && man->usage > man->reclaim_high)
+		queue_delayed_work(bo->bdev->wq, &bo->bdev->reclaim_work, 0);
 	spin_unlock(&bo->bdev->lru_lock);
 }
 EXPORT_SYMBOL(ttm_resource_init);
@@ -396,9 +424,65 @@ void ttm_resource_manager_init(struct ttm_resource_manager *man,
 	for (i = 0; i < TTM_MAX_BO_PRIORITY; ++i)
 		INIT_LIST_HEAD(&man->lru[i]);
 	man->move = NULL;
+
+	man->lru_gens = ttm_lru_gens;
+	man->lru_gen = 0;
+	man->evictions = 0;
+	man->refaults = 0;
+
+	man->reclaim_low = 0;
+	man->reclaim_high = 0;
+	man->reclaim_runs = 0;
+	man->reclaimed = 0;
+	man->reclaim_failed = 0;
 }
 EXPORT_SYMBOL(ttm_resource_manager_init);
 
+/**
+ * ttm_resource_manager_set_watermarks
+ *
+ * @man: memory manager object to configure
+ * @low: usage to evict down to
+ * @high: usage above which to start evicting, 0 to disable
+ *
+ * Configure background reclaim for a manager. Once allocations push the
+ * usage above @high, the device reclaim worker evicts BOs on the device
+ * workqueue until the usage drops to @low, so that the allocations which
+ * follow find free space without evicting inline. Both values are in the
+ * units of ttm_resource_manager_usage().
+ */
+void ttm_resource_manager_set_watermarks(struct ttm_resource_manager *man,
+					 uint64_t low, uint64_t high)
+{
+	WARN_ON(high && low > high);
+
+	spin_lock(&man->bdev->lru_lock);
+	man->reclaim_low = low;
+	man->reclaim_high = high;
+	spin_unlock(&man->bdev->lru_lock);
+}
+EXPORT_SYMBOL(ttm_resource_manager_set_watermarks);
+
+/**
+ * ttm_resource_manager_evicted
+ *
+ * @man: the resource manager the BO was evicted from
+ * @bo: the evicted and still reserved BO
+ *
+ * Account an eviction and remember where the BO came from, so that moving
+ * it back can be counted as a refault.
+ */
+void ttm_resource_manager_evicted(struct ttm_resource_manager *man,
+				  struct ttm_buffer_object *bo)
+{
+	dma_resv_assert_held(bo->base.resv);
+
+	spin_lock(&man->bdev->lru_lock);
+	++man->evictions;
+	bo->evicted_from = man;
+	spin_unlock(&man->bdev->lru_lock);
+}
+
 /*
  * ttm_resource_manager_evict_all
  *
@@ -420,6 +504,9 @@ int ttm_resource_manager_evict_all(struct ttm_device *bdev,
 	int ret;
 	unsigned i;
 
+	/* Don't race with background reclaim on a manager going away */
+	cancel_delayed_work_sync(&bdev->reclaim_work);
+
 	/*
 	 * Can't use standard list traversal since we're unlocking.
 	 */
@@ -483,18 +570,114 @@ void ttm_resource_manager_debug(struct ttm_resource_manager *man,
 	drm_printf(p, "  use_tt: %d\n", man->use_tt);
 	drm_printf(p, "  size: %llu\n", man->size);
 	drm_printf(p, "  usage: %llu\n", ttm_resource_manager_usage(man));
+	spin_lock(&man->bdev->lru_lock);
+	drm_printf(p, "  lru_gens: %d\n", man->lru_gens);
+	if (man->lru_gens)
+		drm_printf(p, "  lru_gen: %u\n", man->lru_gen);
+	drm_printf(p, "  evictions: %llu\n", man->evictions);
+	drm_printf(p, "  refaults: %llu\n", man->refaults);
+	if (man->reclaim_high) {
+		drm_printf(p, "  reclaim_low: %llu\n", man->reclaim_low);
+		drm_printf(p, "  reclaim_high: %llu\n", man->reclaim_high);
+		drm_printf(p, "  reclaim_runs: %llu\n", man->reclaim_runs);
+		drm_printf(p, "  reclaimed: %llu\n", man->reclaimed);
+		drm_printf(p, "  reclaim_failed: %llu\n", man->reclaim_failed);
+	}
+	spin_unlock(&man->bdev->lru_lock);
 	if (man->func->debug)
 		man->func->debug(man, p);
 }
 EXPORT_SYMBOL(ttm_resource_manager_debug);
 
+/*
+ * Number of generations the resource is behind the youngest one, reduced
+ * by the extra protection it got after a refault.
+ */
+static unsigned int ttm_resource_lru_age(struct ttm_resource_manager *man,
+					 struct ttm_resource *res)
+{
+	uint32_t age = man->lru_gen - res->lru_gen;
+
+	age = age > res->lru_tier ? age - res->lru_tier : 0;
+	return min(age, TTM_LRU_NR_GENS - 1);
+}
+
+/*
+ * Return the resource after @res, or the first one if @res is NULL. With
+ * the generational LRU the resources of a priority are returned oldest
+ * generation first, in LRU order within a generation.
+ *
+ * A walk from the head of a list stops at the first resource of the
+ * generation the cursor is at. Failing that, it already saw the whole list
+ * and returns the oldest younger resource it came across. The younger
+ * generations seen are remembered in the cursor, so a list is only walked
+ * again for a generation which still has resources left.
+ */
+static struct ttm_resource *
+ttm_resource_manager_scan(struct ttm_resource_manager *man,
+			  struct ttm_resource_cursor *cursor,
+			  struct ttm_resource *res)
+{
+	struct list_head *lru = &man->lru[cursor->priority];
+	struct ttm_resource *best;
+	unsigned int age, best_age;
+	bool from_head;
+
+	for (;;) {
+		from_head = !res;
+		if (from_head)
+			cursor->younger = 0;
+		best = NULL;
+		best_age = 0;
+
+		res = res ? list_next_entry(res, lru) :
+			list_first_entry(lru, struct ttm_resource, lru);
+		for (; &res->lru != lru; res = list_next_entry(res, lru)) {
+			if (!man->lru_gens)
+				return res;
+
+			age = ttm_resource_lru_age(man, res);
+			if (age == cursor->age)
+				return res;
+			if (age > cursor->age)
+				continue;
+
+			cursor->younger |= BIT(age);
+			if (!best || age > best_age) {
+				best = res;
+				best_age = age;
+			}
+		}
+
+		if (from_head && best) {
+			cursor->age = best_age;
+			cursor->younger &= BIT(best_age) - 1;
+			return best;
+		}
+
+		res = NULL;
+		if (cursor->younger) {
+			cursor->age = fls(cursor->younger) - 1;
+			continue;
+		}
+
+		if (++cursor->priority >= TTM_MAX_BO_PRIORITY)
+			return NULL;
+		lru = &man->lru[cursor->priority];
+		cursor->age = TTM_LRU_NR_GENS - 1;
+	}
+}
+
 /**
  * ttm_resource_manager_first
  *
  * @man: resource manager to iterate over
  * @cursor: cursor to record the position
  *
- * Returns the first resource from the resource manager.
+ * Returns the first resource from the resource manager. With the
+ * generational LRU that is the least recently used resource of the oldest
+ * generation. Once the oldest generation runs empty all resources are aged
+ * by starting a new generation.
  */
 struct ttm_resource *
 ttm_resource_manager_first(struct ttm_resource_manager *man,
@@ -504,12 +687,13 @@ ttm_resource_manager_first(struct ttm_resource_manager *man,
 
 	lockdep_assert_held(&man->bdev->lru_lock);
 
-	for (cursor->priority = 0; cursor->priority < TTM_MAX_BO_PRIORITY;
-	     ++cursor->priority)
-		list_for_each_entry(res, &man->lru[cursor->priority], lru)
-			return res;
+	cursor->priority = 0;
+	cursor->age = TTM_LRU_NR_GENS - 1;
+	res = ttm_resource_manager_scan(man, cursor, NULL);
+	if (res && man->lru_gens && cursor->age != TTM_LRU_NR_GENS - 1)
+		++man->lru_gen;
 
-	return NULL;
+	return res;
 }
 
 /**
@@ -528,15 +712,7 @@ ttm_resource_manager_next(struct ttm_resource_manager *man,
 {
 	lockdep_assert_held(&man->bdev->lru_lock);
 
-	list_for_each_entry_continue(res, &man->lru[cursor->priority], lru)
-		return res;
-
-	for (++cursor->priority; cursor->priority < TTM_MAX_BO_PRIORITY;
-	     ++cursor->priority)
-		list_for_each_entry(res, &man->lru[cursor->priority], lru)
-			return res;
-
-	return NULL;
+	return ttm_resource_manager_scan(man, cursor, res);
 }
 
 static void ttm_kmap_iter_iomap_map_local(struct ttm_kmap_iter *iter,
@@ -632,8 +808,19 @@ static void ttm_kmap_iter_linear_io_map_local(struct ttm_kmap_iter *iter,
 	iosys_map_incr(dmap, i * PAGE_SIZE);
 }
 
+/* The whole resource is mapped, so any run is contiguous */
+static unsigned long
+ttm_kmap_iter_linear_io_map_local_range(struct ttm_kmap_iter *iter,
+					struct iosys_map *dmap, pgoff_t i,
+					unsigned long max_pages)
+{
+	ttm_kmap_iter_linear_io_map_local(iter, dmap, i);
+	return max_pages;
+}
+
 static const struct ttm_kmap_iter_ops ttm_kmap_iter_linear_io_ops = {
 	.map_local =  ttm_kmap_iter_linear_io_map_local,
+	.map_local_range = ttm_kmap_iter_linear_io_map_local_range,
 	.maps_tt = false,
 };
 
@@ -40,9 +40,16 @@
 #include <drm/ttm/ttm_tt.h>
 #ifdef __FreeBSD__
 #include <drm/ttm/ttm_sysctl_freebsd.h>
+
+#include <vm/vm.h>
+#include <vm/pmap.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pager.h>
 #endif
 
 #include "ttm_module.h"
+#include "ttm_zstore.h"
 
 static unsigned long ttm_pages_limit;
 
@@ -54,6 +61,11 @@ static unsigned long ttm_dma32_pages_limit;
 MODULE_PARM_DESC(dma32_pages_limit, "Limit for the allocated DMA32 pages");
 module_param_named(dma32_pages_limit, ttm_dma32_pages_limit, ulong, 0644);
 
+static bool ttm_swap_compress;
+
+MODULE_PARM_DESC(swap_compress, "Compress swapped out pages in memory instead of using shmem");
+module_param_named(swap_compress, ttm_swap_compress, bool, 0644);
+
 static atomic_long_t ttm_pages_allocated;
 static atomic_long_t ttm_dma32_pages_allocated;
 
@@ -161,6 +173,7 @@ static void ttm_tt_init_fields(struct ttm_tt *ttm,
 	ttm->page_flags = page_flags;
 	ttm->dma_address = NULL;
 	ttm->swap_storage = NULL;
+	ttm->swap_zstore = NULL;
 	ttm->sg = bo->sg;
 	ttm->caching = caching;
 }
@@ -186,6 +199,7 @@ void ttm_tt_fini(struct ttm_tt *ttm)
 	if (ttm->swap_storage)
 		fput(ttm->swap_storage);
 	ttm->swap_storage = NULL;
+	ttm_zstore_free(ttm);
 
 	if (ttm->pages)
 		kvfree(ttm->pages);
@@ -215,6 +229,86 @@ int ttm_sg_tt_init(struct ttm_tt *ttm, struct ttm_buffer_object *bo,
 }
 EXPORT_SYMBOL(ttm_sg_tt_init);
 
+#ifdef __FreeBSD__
+/* Upper bound for the pages grabbed from the swap object at once */
+#define TTM_TT_SWAP_RUN 64
+
+/*
+ * Number of physically contiguous pages starting at index @i. The pool
+ * records the order of every page, so this is normally the rest of the
+ * chunk @i belongs to. Still check the pages, drivers populating the
+ * ttm_tt themselves don't fill in the orders.
+ */
+static int ttm_tt_swap_run(struct ttm_tt *ttm, int i)
+{
+	int n, max;
+
+	max = min3(1 << ttm->orders[i], (int)ttm->num_pages - i,
+		   TTM_TT_SWAP_RUN);
+	for (n = 1; n < max; ++n)
+		if (ttm->pages[i + n] != ttm->pages[i] + n)
+			break;
+
+	return n;
+}
+
+/*
+ * Copy a run of contiguous pages into the swap object. The object was just
+ * created, so grab all destination pages at once and skip paging them in
+ * or zero filling them before they are overwritten anyway.
+ */
+static int ttm_tt_swapout_run(vm_object_t obj, int pindex,
+			      struct page *from, int count)
+{
+	vm_page_t ma[TTM_TT_SWAP_RUN];
+	int i, n;
+
+	VM_OBJECT_WLOCK(obj);
+	n = vm_page_grab_pages(obj, pindex, VM_ALLOC_NORMAL | VM_ALLOC_WIRED,
+			       ma, count);
+	VM_OBJECT_WUNLOCK(obj);
+
+	for (i = 0; i < n; ++i) {
+		pmap_copy_page(from + i, ma[i]);
+		vm_page_valid(ma[i]);
+		vm_page_dirty(ma[i]);
+		vm_page_xunbusy(ma[i]);
+		vm_page_unwire(ma[i], PQ_ACTIVE);
+	}
+
+	return n == count ? 0 : -ENOMEM;
+}
+
+/*
+ * Copy a run of pages back from the swap object, taking the object lock
+ * once for the whole run. Pages which were not populated at swapout time
+ * never made it into the object and come back zero filled.
+ */
+static int ttm_tt_swapin_run(vm_object_t obj, int pindex, struct page *to,
+			     int count)
+{
+	vm_page_t ma[TTM_TT_SWAP_RUN];
+	int i, n, rv = VM_PAGER_OK;
+
+	VM_OBJECT_WLOCK(obj);
+	for (n = 0; n < count; ++n) {
+		rv = vm_page_grab_valid(&ma[n], obj, pindex + n,
+					VM_ALLOC_NORMAL | VM_ALLOC_NOBUSY |
+					VM_ALLOC_WIRED);
+		if (rv != VM_PAGER_OK)
+			break;
+	}
+	VM_OBJECT_WUNLOCK(obj);
+
+	for (i = 0; i < n; ++i) {
+		pmap_copy_page(ma[i], to + i);
+		vm_page_unwire(ma[i], PQ_ACTIVE);
+	}
+
+	return rv == VM_PAGER_OK ? 0 : -EIO;
+}
+#endif
+
 int ttm_tt_swapin(struct ttm_tt *ttm)
 {
 #ifdef __linux__
@@ -223,38 +317,62 @@ int ttm_tt_swapin(struct ttm_tt *ttm)
 	vm_object_t swap_space;
 #endif
 	struct file *swap_storage;
+#ifdef __linux__
 	struct page *from_page;
 	struct page *to_page;
 	gfp_t gfp_mask;
+#elif defined(__FreeBSD__)
+	int n;
+#endif
 	int i, ret;
 
+	if (ttm->swap_zstore) {
+		ret = ttm_zstore_swapin(ttm);
+		if (ret)
+			return ret;
+		ttm->page_flags &= ~TTM_TT_FLAG_SWAPPED;
+		return 0;
+	}
+
 	swap_storage = ttm->swap_storage;
 	BUG_ON(swap_storage == NULL);
 
 #ifdef __linux__
 	swap_space = swap_storage->f_mapping;
 	gfp_mask = mapping_gfp_mask(swap_space);
-#elif defined(__FreeBSD__)
-	swap_space = swap_storage->f_shmem;
-	gfp_mask = 0;
-#endif
 
 	for (i = 0; i < ttm->num_pages; ++i) {
+		to_page = ttm->pages[i];
+		if (unlikely(to_page == NULL)) {
+			ret = -ENOMEM;
+			goto out_err;
+		}
+
 		from_page = shmem_read_mapping_page_gfp(swap_space, i,
 							gfp_mask);
 		if (IS_ERR(from_page)) {
 			ret = PTR_ERR(from_page);
 			goto out_err;
 		}
-		to_page = ttm->pages[i];
-		if (unlikely(to_page == NULL)) {
+
+		copy_highpage(to_page, from_page);
+		put_page(from_page);
+	}
+#elif defined(__FreeBSD__)
+	swap_space = swap_storage->f_shmem;
+
+	for (i = 0; i < ttm->num_pages; i += n) {
+		if (unlikely(ttm->pages[i] == NULL)) {
 			ret = -ENOMEM;
 			goto out_err;
 		}
 
-		copy_highpage(to_page, from_page);
-		put_page(from_page);
+		n = ttm_tt_swap_run(ttm, i);
+		ret = ttm_tt_swapin_run(swap_space, i, ttm->pages[i], n);
+		if (ret)
+			goto out_err;
 	}
+#endif
 
 	fput(swap_storage);
 	ttm->swap_storage = NULL;
@@ -273,7 +391,8 @@ out_err:
  * @ttm: The struct ttm_tt.
  * @gfp_flags: Flags to use for memory allocation.
  *
- * Swapout a TT object to a shmem_file, return number of pages swapped out or
+ * Swapout a TT object to a shmem_file, or into compressed memory when the
+ * swap_compress parameter is set, return number of pages swapped out or
  * negative error code.
  */
 int ttm_tt_swapout(struct ttm_device *bdev, struct ttm_tt *ttm,
@@ -286,10 +405,21 @@ int ttm_tt_swapout(struct ttm_device *bdev, struct ttm_tt *ttm,
 	vm_object_t swap_space;
 #endif
 	struct file *swap_storage;
+#ifdef __linux__
 	struct page *from_page;
 	struct page *to_page;
+#elif defined(__FreeBSD__)
+	int n;
+#endif
 	int i, ret;
 
+	if (READ_ONCE(ttm_swap_compress) &&
+	    !ttm_zstore_swapout(ttm, gfp_flags | __GFP_NOWARN)) {
+		ttm_tt_unpopulate(bdev, ttm);
+		ttm->page_flags |= TTM_TT_FLAG_SWAPPED;
+		return ttm->num_pages;
+	}
+
 	swap_storage = shmem_file_setup("ttm swap", size, 0);
 	if (IS_ERR(swap_storage)) {
 		pr_err("Failed allocating swap storage\n");
@@ -304,6 +434,7 @@ int ttm_tt_swapout(struct ttm_device *bdev, struct ttm_tt *ttm,
 	gfp_flags = 0;
 #endif
 
+#ifdef __linux__
 	for (i = 0; i < ttm->num_pages; ++i) {
 		from_page = ttm->pages[i];
 		if (unlikely(from_page == NULL))
@@ -319,6 +450,19 @@ int ttm_tt_swapout(struct ttm_device *bdev, struct ttm_tt *ttm,
 		mark_page_accessed(to_page);
 		put_page(to_page);
 	}
+#elif defined(__FreeBSD__)
+	for (i = 0; i < ttm->num_pages; i += n) {
+		if (unlikely(ttm->pages[i] == NULL)) {
+			n = 1;
+			continue;
+		}
+
+		n = ttm_tt_swap_run(ttm, i);
+		ret = ttm_tt_swapout_run(swap_space, i, ttm->pages[i], n);
+		if (ret)
+			goto out_err;
+	}
+#endif
 
 	ttm_tt_unpopulate(bdev, ttm);
 	ttm->swap_storage = swap_storage;
@@ -436,6 +580,7 @@ void ttm_tt_mgr_init(unsigned long num_pages, unsigned long num_dma32_pages)
 	debugfs_create_file("tt_shrink", 0400, ttm_debugfs_root, NULL,
 			    &ttm_tt_debugfs_shrink_fops);
 #endif
+	ttm_zstore_debugfs_init(ttm_debugfs_root);
 
 	if (!ttm_pages_limit)
 		ttm_pages_limit = num_pages;
@@ -461,9 +606,53 @@ static void ttm_kmap_iter_tt_unmap_local(struct ttm_kmap_iter *iter,
 	kunmap_local(map->vaddr);
 }
 
+/*
+ * Physically contiguous pages from the pool usually end up virtually
+ * contiguous as well, e.g. in the direct map. Extend the run for as long as
+ * both holds.
+ */
+static unsigned long
+ttm_kmap_iter_tt_map_local_range(struct ttm_kmap_iter *iter,
+				 struct iosys_map *dmap, pgoff_t i,
+				 unsigned long max_pages)
+{
+	struct ttm_kmap_iter_tt *iter_tt =
+		container_of(iter, typeof(*iter_tt), base);
+	struct page **pages = iter_tt->tt->pages + i;
+	void *vaddr, *next;
+	unsigned long n;
+
+#ifdef __FreeBSD__
+	/* No chunk extends further than its order */
+	max_pages = min_t(unsigned long, max_pages,
+			  1UL << iter_tt->tt->orders[i]);
+#endif
+	vaddr = kmap_local_page_prot(pages[0], iter_tt->prot);
+	for (n = 1; n < max_pages && pages[n] == pages[0] + n; ++n) {
+		next = kmap_local_page_prot(pages[n], iter_tt->prot);
+		if (next != vaddr + n * PAGE_SIZE) {
+			kunmap_local(next);
+			break;
+		}
+	}
+	iosys_map_set_vaddr(dmap, vaddr);
+
+	return n;
+}
+
+static void ttm_kmap_iter_tt_unmap_local_range(struct ttm_kmap_iter *iter,
+					       struct iosys_map *map,
+					       unsigned long num_pages)
+{
+	while (num_pages--)
+		kunmap_local(map->vaddr + num_pages * PAGE_SIZE);
+}
+
 static const struct ttm_kmap_iter_ops ttm_kmap_iter_tt_ops = {
 	.map_local = ttm_kmap_iter_tt_map_local,
 	.unmap_local = ttm_kmap_iter_tt_unmap_local,
+	.map_local_range = ttm_kmap_iter_tt_map_local_range,
+	.unmap_local_range = ttm_kmap_iter_tt_unmap_local_range,
 	.maps_tt = true,
 };
 
@@ -0,0 +1,387 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+
+/*
+ * In-memory compressed backing store for swapped out TT objects.
+ *
+ * Instead of copying the pages to a shmem object, every populated page is
+ * compressed into a kmalloc'ed buffer using the LZ4 block format. Pages
+ * which are entirely zero only get a marker, pages which were never
+ * populated are not stored at all and come back cleared. If the object as a
+ * whole doesn't compress well enough the store is dropped again and the
+ * caller falls back to shmem, which can at least be paged out to disk.
+ */
+
+#include <linux/debugfs.h>
+#include <linux/highmem.h>
+#include <linux/mm.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <asm/unaligned.h>
+#include <drm/ttm/ttm_tt.h>
+
+#include "ttm_zstore.h"
+
+#define TTM_LZ_HASH_BITS	12
+#define TTM_LZ_MIN_MATCH	4
+#define TTM_LZ_LAST_LITERALS	5
+#define TTM_LZ_MFLIMIT		12
+
+/* Give up on the store when it would take more than 3/4 of the pages */
+#define TTM_ZSTORE_MAX_RATIO(x)	((x) / 4 * 3)
+
+struct ttm_zpage {
+	unsigned int len;
+	u8 data[];
+};
+
+struct ttm_zstore {
+	unsigned long num_pages;
+	size_t size;
+	struct ttm_zpage *pages[];
+};
+
+/* Shared marker for pages which were entirely zero */
+static struct ttm_zpage ttm_zpage_zero;
+
+static atomic_long_t ttm_zstore_pages;
+static atomic_long_t ttm_zstore_bytes;
+static atomic_long_t ttm_zstore_rejected;
+
+static inline u32 ttm_lz_hash(u32 seq)
+{
+	return (seq * 2654435761U) >> (32 - TTM_LZ_HASH_BITS);
+}
+
+static u8 *ttm_lz_put_len(u8 *op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+		*op++ = 255;
+	*op++ = len;
+	return op;
+}
+
+/* Emit one sequence, a match_len of zero ends the block */
+static u8 *ttm_lz_put_seq(u8 *op, u8 *oend, const u8 *lit, size_t lit_len,
+			  size_t offset, size_t match_len)
+{
+	size_t ml = match_len ? match_len - TTM_LZ_MIN_MATCH : 0;
+	u8 *token;
+
+	if (op + 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1 > oend)
+		return NULL;
+
+	token = op++;
+	if (lit_len >= 15) {
+		*token = 15 << 4;
+		op = ttm_lz_put_len(op, lit_len - 15);
+	} else {
+		*token = lit_len << 4;
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+
+	if (!match_len)
+		return op;
+
+	*op++ = offset;
+	*op++ = offset >> 8;
+	if (ml >= 15) {
+		*token |= 15;
+		op = ttm_lz_put_len(op, ml - 15);
+	} else {
+		*token |= ml;
+	}
+	return op;
+}
+
+/*
+ * Greedy single pass LZ4 block compressor. Returns the compressed size or 0
+ * if the result doesn't fit into @dst_len bytes.
+ */
+static size_t ttm_lz_compress(const u8 *src, size_t len, u8 *dst,
+			      size_t dst_len, u16 *table)
+{
+	const u8 *ip = src, *anchor = src;
+	u8 *op = dst, *oend = dst + dst_len;
+
+	memset(table, 0, sizeof(*table) << TTM_LZ_HASH_BITS);
+
+	if (len > TTM_LZ_MFLIMIT) {
+		const u8 *mflimit = src + len - TTM_LZ_MFLIMIT;
+		const u8 *matchlimit = src + len - TTM_LZ_LAST_LITERALS;
+
+		while (ip <= mflimit) {
+			u32 seq = get_unaligned_le32(ip);
+			u32 h = ttm_lz_hash(seq);
+			const u8 *ref = src + table[h];
+			size_t match_len;
+
+			table[h] = ip - src;
+			if (ref >= ip || ip - ref > 0xffff ||
+			    get_unaligned_le32(ref) != seq) {
+				ip++;
+				continue;
+			}
+
+			match_len = TTM_LZ_MIN_MATCH;
+			while (ip + match_len < matchlimit &&
+			       ref[match_len] == ip[match_len])
+				match_len++;
+
+			op = ttm_lz_put_seq(op, oend, anchor, ip - anchor,
+					    ip - ref, match_len);
+			if (!op)
+				return 0;
+			ip += match_len;
+			anchor = ip;
+		}
+	}
+
+	op = ttm_lz_put_seq(op, oend, anchor, src + len - anchor, 0, 0);
+	return op ? op - dst : 0;
+}
+
+static int ttm_lz_decompress(const u8 *src, size_t len, u8 *dst,
+			     size_t dst_len)
+{
+	const u8 *ip = src, *iend = src + len;
+	u8 *op = dst, *oend = dst + dst_len;
+
+	while (ip < iend) {
+		unsigned int token = *ip++;
+		size_t lit_len = token >> 4;
+		size_t match_len = token & 15;
+		size_t offset;
+		u8 b;
+
+		if (lit_len == 15) {
+			do {
+				if (ip >= iend)
+					return -EINVAL;
+				b = *ip++;
+				lit_len += b;
+			} while (b == 255);
+		}
+		if (lit_len > iend - ip || lit_len > oend - op)
+			return -EINVAL;
+		memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		/* The last sequence has no match part */
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			return -EINVAL;
+		offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if (!offset || offset > op - dst)
+			return -EINVAL;
+
+		if (match_len == 15) {
+			do {
+				if (ip >= iend)
+					return -EINVAL;
+				b = *ip++;
+				match_len += b;
+			} while (b == 255);
+		}
+		match_len += TTM_LZ_MIN_MATCH;
+		if (match_len > oend - op)
+			return -EINVAL;
+		for (; match_len; --match_len, ++op)
+			*op = op[-offset];
+	}
+
+	return op == oend ? 0 : -EINVAL;
+}
+
+static void ttm_zstore_destroy(struct ttm_zstore *zs)
+{
+	unsigned long i, count = 0;
+
+	for (i = 0; i < zs->num_pages; ++i) {
+		if (!zs->pages[i])
+			continue;
+		if (zs->pages[i] != &ttm_zpage_zero)
+			kfree(zs->pages[i]);
+		++count;
+	}
+	atomic_long_sub(count, &ttm_zstore_pages);
+	atomic_long_sub(zs->size, &ttm_zstore_bytes);
+	kvfree(zs);
+}
+
+/**
+ * ttm_zstore_swapout - compress the pages of a TT object
+ *
+ * @ttm: The populated struct ttm_tt.
+ * @gfp: Flags to use for memory allocation.
+ *
+ * Compress all populated pages of @ttm into a new store attached to
+ * ttm->swap_zstore. The pages themselves are left alone, unpopulating them
+ * is up to the caller. Returns -EFBIG when the data doesn't compress well
+ * enough to be worth keeping in memory.
+ */
+int ttm_zstore_swapout(struct ttm_tt *ttm, gfp_t gfp)
+{
+	size_t limit = TTM_ZSTORE_MAX_RATIO((size_t)ttm->num_pages << PAGE_SHIFT);
+	unsigned long i, count = 0;
+	struct ttm_zstore *zs;
+	struct ttm_zpage *zp;
+	u16 *table;
+	u8 *buf;
+	int ret;
+
+	zs = kvzalloc(struct_size(zs, pages, ttm->num_pages), gfp);
+	if (!zs)
+		return -ENOMEM;
+	zs->num_pages = ttm->num_pages;
+
+	buf = kmalloc(PAGE_SIZE + (sizeof(*table) << TTM_LZ_HASH_BITS), gfp);
+	if (!buf) {
+		kvfree(zs);
+		return -ENOMEM;
+	}
+	table = (u16 *)(buf + PAGE_SIZE);
+
+	for (i = 0; i < ttm->num_pages; ++i) {
+		struct page *p = ttm->pages[i];
+		size_t len;
+		void *src;
+
+		if (!p)
+			continue;
+
+		src = kmap_local_page(p);
+		if (!memchr_inv(src, 0, PAGE_SIZE)) {
+			kunmap_local(src);
+			zs->pages[i] = &ttm_zpage_zero;
+			++count;
+			continue;
+		}
+
+		len = ttm_lz_compress(src, PAGE_SIZE, buf, PAGE_SIZE - 1, table);
+		if (!len)
+			len = PAGE_SIZE;
+
+		if (zs->size + len > limit) {
+			kunmap_local(src);
+			atomic_long_inc(&ttm_zstore_rejected);
+			ret = -EFBIG;
+			goto error_free;
+		}
+
+		zp = kmalloc(struct_size(zp, data, len), gfp);
+		if (!zp) {
+			kunmap_local(src);
+			ret = -ENOMEM;
+			goto error_free;
+		}
+		zp->len = len;
+		memcpy(zp->data, len == PAGE_SIZE ? src : buf, len);
+		kunmap_local(src);
+
+		zs->pages[i] = zp;
+		zs->size += len;
+		++count;
+	}
+	kfree(buf);
+
+	atomic_long_add(count, &ttm_zstore_pages);
+	atomic_long_add(zs->size, &ttm_zstore_bytes);
+	ttm->swap_zstore = zs;
+	return 0;
+
+error_free:
+	kfree(buf);
+	for (i = 0; i < zs->num_pages; ++i)
+		if (zs->pages[i] != &ttm_zpage_zero)
+			kfree(zs->pages[i]);
+	kvfree(zs);
+	return ret;
+}
+
+/**
+ * ttm_zstore_swapin - restore the pages of a TT object
+ *
+ * @ttm: The freshly populated struct ttm_tt.
+ *
+ * Decompress ttm->swap_zstore into the pages of @ttm and drop the store.
+ */
+int ttm_zstore_swapin(struct ttm_tt *ttm)
+{
+	struct ttm_zstore *zs = ttm->swap_zstore;
+	unsigned long i;
+	int ret = 0;
+
+	for (i = 0; i < zs->num_pages; ++i) {
+		struct ttm_zpage *zp = zs->pages[i];
+		struct page *p = ttm->pages[i];
+		void *dst;
+
+		if (unlikely(p == NULL))
+			return -ENOMEM;
+
+		if (!zp || zp == &ttm_zpage_zero) {
+			clear_highpage(p);
+			continue;
+		}
+
+		dst = kmap_local_page(p);
+		if (zp->len == PAGE_SIZE)
+			memcpy(dst, zp->data, PAGE_SIZE);
+		else
+			ret = ttm_lz_decompress(zp->data, zp->len, dst,
+						PAGE_SIZE);
+		kunmap_local(dst);
+		if (WARN_ON(ret))
+			return ret;
+	}
+
+	ttm_zstore_free(ttm);
+	return 0;
+}
+
+/**
+ * ttm_zstore_free - drop the compressed store of a TT object
+ *
+ * @ttm: The struct ttm_tt.
+ */
+void ttm_zstore_free(struct ttm_tt *ttm)
+{
+	if (!ttm->swap_zstore)
+		return;
+
+	ttm_zstore_destroy(ttm->swap_zstore);
+	ttm->swap_zstore = NULL;
+}
+
+#ifdef CONFIG_DEBUG_FS
+
+static int ttm_zstore_debugfs_show(struct seq_file *m, void *data)
+{
+	unsigned long pages = atomic_long_read(&ttm_zstore_pages);
+	unsigned long bytes = atomic_long_read(&ttm_zstore_bytes);
+
+	seq_printf(m, "pages: %lu\n", pages);
+	seq_printf(m, "bytes: %lu\n", bytes);
+	seq_printf(m, "ratio: %lu%%\n",
+		   pages ? bytes * 100 / (pages << PAGE_SHIFT) : 0);
+	seq_printf(m, "rejected: %lu\n",
+		   atomic_long_read(&ttm_zstore_rejected));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(ttm_zstore_debugfs);
+
+#endif
+
+void ttm_zstore_debugfs_init(struct dentry *root)
+{
+#ifdef CONFIG_DEBUG_FS
+	debugfs_create_file("tt_zstore", 0400, root, NULL,
+			    &ttm_zstore_debugfs_fops);
+#endif
+}
@@ -0,0 +1,16 @@
+/* SPDX-License-Identifier: GPL-2.0 OR MIT */
+
+#ifndef _TTM_ZSTORE_H_
+#define _TTM_ZSTORE_H_
+
+#include <linux/types.h>
+
+struct dentry;
+struct ttm_tt;
+
+int ttm_zstore_swapout(struct ttm_tt *ttm, gfp_t gfp);
+int ttm_zstore_swapin(struct ttm_tt *ttm);
+void ttm_zstore_free(struct ttm_tt *ttm);
+void ttm_zstore_debugfs_init(struct dentry *root);
+
+#endif
@@ -34,6 +34,8 @@
 #include <sys/cdefs.h>
 __FBSDID("$FreeBSD$");
 
+#include <sys/param.h>
+#include <sys/malloc.h>
 #include <sys/reboot.h>
 #include <sys/fbio.h>
 #include <dev/vt/vt.h>
@@ -41,8 +43,10 @@ __FBSDID("$FreeBSD$");
 #include <dev/vt/colors/vt_termcolors.h>
 
 #include <linux/fb.h>
+#include <linux/io.h>
 
 #include <drm/drm_fb_helper.h>
+#include <drm/drm_rect.h>
 
 /*
  * `drm_fb_helper.h` redefines `fb_info` to be `linux_fb_info` to manage the
@@ -61,6 +65,66 @@ __FBSDID("$FreeBSD$");
 #define	to_drm_fb_helper(fbio) ((struct drm_fb_helper *)fbio->fb_priv)
 #define	to_linux_fb_info(fbio) (to_drm_fb_helper(fbio)->info)
 
+MALLOC_DEFINE(M_VT_DRMFB, "vt_drmfb", "vt_drmfb state");
+
+#define	VT_DRMFB_MAX_CELLS \
+	(PIXEL_HEIGHT(VT_FB_MAX_HEIGHT) * PIXEL_WIDTH(VT_FB_MAX_WIDTH))
+
+#ifndef VT_TIMERFREQ
+#define	VT_TIMERFREQ		25
+#endif
+/* Damage is flushed at most once per vt(4) refresh. */
+#define	VT_DRMFB_FLUSH_TICKS	MAX(1, hz / VT_TIMERFREQ)
+#define	VT_DRMFB_MAX_DAMAGE	8
+/* Large enough for a row of the screen or any glyph. */
+#define	VT_DRMFB_SCRATCH_MIN	(64 * 1024)
+
+/*
+ * What we know is currently displayed in a text cell. This mirrors
+ * `vd_drawn`, `vd_drawnfg` and `vd_drawnbg` but is only updated when the
+ * cell is actually drawn, so it still describes the old screen content while
+ * vt(4) flushes a new one.
+ */
+struct vt_drmfb_cell {
+	term_char_t	c;
+	term_color_t	fg;
+	term_color_t	bg;
+	bool		valid;
+};
+
+/*
+ * vt(4) draws into a system memory shadow buffer, and the damaged areas are
+ * flushed to the framebuffer once per refresh from a task. If the fbdev
+ * driver already has a shadow buffer in system memory (FBINFO_READS_FAST, as
+ * with the generic fbdev emulation), we draw into it directly and flushing
+ * is only a matter of reporting the damage to the driver. Otherwise, we own
+ * the shadow buffer and copy it to the framebuffer ourselves.
+ */
+struct vt_drmfb_softc {
+	struct linux_fb_info	*info;
+	struct linux_fb_surface	 shadow;
+	bool			 own_shadow;
+	/* Used to render a glyph or a row before comparing it to the shadow. */
+	uint8_t			*scratch;
+	size_t			 scratch_size;
+
+	struct mtx		 lock;		/* Protects the fields below */
+	struct timeout_task	 flush_task;
+	bool			 flush_pending;
+	unsigned int		 ndamage;
+	struct drm_rect		 damage[VT_DRMFB_MAX_DAMAGE];
+
+	/* Font the cell cache was filled with. */
+	const struct vt_font	*font;
+	/* Row offset of the last successful scroll, tried first next time. */
+	unsigned int		 scroll_offset;
+	/* Last row we failed to find elsewhere on screen, or -1. */
+	int			 miss_row;
+	struct vt_drmfb_cell	 cells[VT_DRMFB_MAX_CELLS];
+};
+
+#define	to_vt_drmfb_softc(fbio) (to_linux_fb_info(fbio)->fb_vt_softc)
+
 vd_init_t		vt_drmfb_init;
 vd_fini_t		vt_drmfb_fini;
 vd_blank_t		vt_drmfb_blank;
@@ -102,6 +166,427 @@ static struct vt_driver vt_drmfb_driver = {
 
 VT_DRIVER_DECLARE(vt_drmfb, vt_drmfb_driver);
 
+static void
+vt_drmfb_flush(struct vt_drmfb_softc *sc)
+{
+	struct linux_fb_info *info;
+	struct drm_rect damage[VT_DRMFB_MAX_DAMAGE];
+	unsigned int ndamage, i, y;
+	size_t offset, len;
+	bool reschedule;
+
+	info = sc->info;
+
+	/*
+	 * Keep the damage while writes are frozen and try again at the next
+	 * refresh. The flush stays pending, so new damage doesn't queue it
+	 * a second time. In the debugger, damage is flushed as it comes.
+	 */
+	reschedule = false;
+	if (!kdb_active && !KERNEL_PANICKED())
+		mtx_lock(&sc->lock);
+	if (info->fbio.fb_flags & FB_FLAG_NOWRITE) {
+		ndamage = 0;
+		reschedule = !kdb_active && !KERNEL_PANICKED();
+		sc->flush_pending = reschedule;
+	} else {
+		sc->flush_pending = false;
+		ndamage = sc->ndamage;
+		memcpy(damage, sc->damage, ndamage * sizeof(damage[0]));
+		sc->ndamage = 0;
+	}
+	if (!kdb_active && !KERNEL_PANICKED())
+		mtx_unlock(&sc->lock);
+
+	if (reschedule) {
+		taskqueue_enqueue_timeout(taskqueue_thread, &sc->flush_task,
+		    VT_DRMFB_FLUSH_TICKS);
+		return;
+	}
+
+	for (i = 0; i < ndamage; ++i) {
+		if (sc->own_shadow) {
+			len = (size_t)drm_rect_width(&damage[i]) *
+			    sc->shadow.cpp;
+			for (y = damage[i].y1; y < damage[i].y2; ++y) {
+				offset = (size_t)sc->shadow.line_length * y +
+				    (size_t)damage[i].x1 * sc->shadow.cpp;
+				memcpy_toio(info->screen_base + offset,
+				    sc->shadow.base + offset, len);
+			}
+		}
+
+#ifdef CONFIG_DRM_FBDEV_EMULATION
+		if (to_drm_fb_helper((&info->fbio))->funcs->fb_dirty != NULL)
+			drm_fb_helper_damage_area(info,
+			    damage[i].x1, damage[i].y1,
+			    drm_rect_width(&damage[i]),
+			    drm_rect_height(&damage[i]));
+#endif
+	}
+}
+
+static void
+vt_drmfb_flush_task(void *arg, int pending __unused)
+{
+	struct vt_drmfb_softc *sc;
+
+	sc = arg;
+	linux_set_current(curthread);
+	vt_drmfb_flush(sc);
+}
+
+/*
+ * Record that an area of the shadow buffer changed. Overlapping or adjacent
+ * areas are merged, so that a burst of glyphs ends up as a few rectangles
+ * flushed at the next refresh. In the debugger or after a panic, there is no
+ * next refresh and the area is flushed immediately.
+ */
+static void
+vt_drmfb_damage(struct vt_drmfb_softc *sc, uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height)
+{
+	struct drm_rect r, u;
+	uint64_t growth, best_growth;
+	unsigned int i, best;
+	bool schedule;
+
+	x = MIN(x, sc->shadow.width);
+	y = MIN(y, sc->shadow.height);
+	width = MIN(width, sc->shadow.width - x);
+	height = MIN(height, sc->shadow.height - y);
+	if (width == 0 || height == 0)
+		return;
+	drm_rect_init(&r, x, y, width, height);
+
+	if (!kdb_active && !KERNEL_PANICKED())
+		mtx_lock(&sc->lock);
+	for (i = 0; i < sc->ndamage; ++i) {
+		if (r.x1 <= sc->damage[i].x2 && sc->damage[i].x1 <= r.x2 &&
+		    r.y1 <= sc->damage[i].y2 && sc->damage[i].y1 <= r.y2)
+			break;
+	}
+	if (i == sc->ndamage && sc->ndamage < VT_DRMFB_MAX_DAMAGE) {
+		sc->damage[sc->ndamage++] = r;
+	} else {
+		if (i == sc->ndamage) {
+			/* No room left: grow the rectangle growing least. */
+			best = 0;
+			best_growth = UINT64_MAX;
+			for (i = 0; i < sc->ndamage; ++i) {
+				u.x1 = MIN(r.x1, sc->damage[i].x1);
+				u.y1 = MIN(r.y1, sc->damage[i].y1);
+				u.x2 = MAX(r.x2, sc->damage[i].x2);
+				u.y2 = MAX(r.y2, sc->damage[i].y2);
+				growth = (uint64_t)drm_rect_width(&u) *
+				    drm_rect_height(&u) -
+				    (uint64_t)drm_rect_width(&sc->damage[i]) *
+				    drm_rect_height(&sc->damage[i]);
+				if (growth < best_growth) {
+					best = i;
+					best_growth = growth;
+				}
+			}
+			i = best;
+		}
+		sc->damage[i].x1 = MIN(r.x1, sc->damage[i].x1);
+		sc->damage[i].y1 = MIN(r.y1, sc->damage[i].y1);
+		sc->damage[i].x2 = MAX(r.x2, sc->damage[i].x2);
+		sc->damage[i].y2 = MAX(r.y2, sc->damage[i].y2);
+	}
+	schedule = !sc->flush_pending;
+	sc->flush_pending = true;
+
+	if (kdb_active || KERNEL_PANICKED()) {
+		vt_drmfb_flush(sc);
+		return;
+	}
+	mtx_unlock(&sc->lock);
+
+	if (schedule)
+		taskqueue_enqueue_timeout(taskqueue_thread, &sc->flush_task,
+		    VT_DRMFB_FLUSH_TICKS);
+}
+
+static void
+vt_drmfb_damage_all(struct vt_drmfb_softc *sc)
+{
+	vt_drmfb_damage(sc, 0, 0, sc->shadow.width, sc->shadow.height);
+}
+
+/*
+ * Copy `height` rows of `width` pixels from `src` to the shadow buffer at
+ * (`x`, `y`), skipping the rows whose content did not change, and mark the
+ * changed rows as damaged.
+ */
+static void
+vt_drmfb_shadow_update(struct vt_drmfb_softc *sc, uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height, const uint8_t *src, size_t src_stride)
+{
+	uint32_t yi, first, last;
+	size_t len;
+	uint8_t *dst;
+
+	len = (size_t)width * sc->shadow.cpp;
+	dst = sc->shadow.base + (size_t)sc->shadow.line_length * y +
+	    (size_t)x * sc->shadow.cpp;
+	first = height;
+	last = 0;
+	for (yi = 0; yi < height; ++yi) {
+		if (memcmp(dst, src, len) != 0) {
+			memcpy(dst, src, len);
+			first = MIN(first, yi);
+			last = yi;
+		}
+		dst += sc->shadow.line_length;
+		src += src_stride;
+	}
+
+	if (first < height)
+		vt_drmfb_damage(sc, x, y + first, width, last - first + 1);
+}
+
+static void
+vt_drmfb_shadow_fillrect(struct vt_drmfb_softc *sc,
+    const struct fb_fillrect *rect)
+{
+	struct linux_fb_surface row;
+	struct fb_fillrect rowrect;
+	uint32_t width, height;
+
+	if (rect->dx >= sc->shadow.width || rect->dy >= sc->shadow.height)
+		return;
+	width = MIN(rect->width, sc->shadow.width - rect->dx);
+	height = MIN(rect->height, sc->shadow.height - rect->dy);
+
+	/* Fill one row in the scratch buffer, then compare each row to it. */
+	row = sc->shadow;
+	row.base = sc->scratch;
+	row.size = sc->scratch_size;
+	row.line_length = width * sc->shadow.cpp;
+	row.width = width;
+	row.height = 1;
+	if (row.line_length > row.size) {
+		linux_fb_surface_fillrect(&sc->shadow, rect);
+		vt_drmfb_damage(sc, rect->dx, rect->dy, width, height);
+		return;
+	}
+
+	rowrect = *rect;
+	rowrect.dx = 0;
+	rowrect.dy = 0;
+	rowrect.height = 1;
+	linux_fb_surface_fillrect(&row, &rowrect);
+
+	vt_drmfb_shadow_update(sc, rect->dx, rect->dy, width, height,
+	    sc->scratch, 0);
+}
+
+static void
+vt_drmfb_shadow_imageblit(struct vt_drmfb_softc *sc,
+    const struct fb_image *image)
+{
+	struct linux_fb_surface glyph;
+	struct fb_image local;
+	uint32_t width, height;
+
+	if (image->dx >= sc->shadow.width || image->dy >= sc->shadow.height)
+		return;
+	width = MIN(image->width, sc->shadow.width - image->dx);
+	height = MIN(image->height, sc->shadow.height - image->dy);
+
+	/*
+	 * The mouse pointer is drawn on top of the screen content, and large
+	 * images are unlikely to be drawn twice: draw them directly.
+	 */
+	glyph = sc->shadow;
+	glyph.base = sc->scratch;
+	glyph.size = sc->scratch_size;
+	glyph.line_length = image->width * sc->shadow.cpp;
+	glyph.width = image->width;
+	glyph.height = image->height;
+	if (image->mask != NULL ||
+	    (size_t)glyph.line_length * glyph.height > glyph.size) {
+		linux_fb_surface_imageblit(&sc->shadow, image);
+		vt_drmfb_damage(sc, image->dx, image->dy, width, height);
+		return;
+	}
+
+	local = *image;
+	local.dx = 0;
+	local.dy = 0;
+	linux_fb_surface_imageblit(&glyph, &local);
+
+	vt_drmfb_shadow_update(sc, image->dx, image->dy, width, height,
+	    sc->scratch, glyph.line_length);
+}
+
+static void
+vt_drmfb_shadow_copyarea(struct vt_drmfb_softc *sc,
+    const struct fb_copyarea *area)
+{
+	linux_fb_surface_copyarea(&sc->shadow, area);
+	vt_drmfb_damage(sc, area->dx, area->dy, area->width, area->height);
+}
+
+/*
+ * Forget what is displayed in the text cells overlapping the given pixel
+ * area, because something other than a glyph was drawn there.
+ */
+static void
+vt_drmfb_cells_invalidate(struct vt_device *vd, const struct vt_window *vw,
+    unsigned int x, unsigned int y, unsigned int width, unsigned int height)
+{
+	struct vt_drmfb_softc *sc;
+	const struct vt_font *vf;
+	unsigned int x1, y1, x2, y2;
+	unsigned int row, col, row1, row2, col1, col2;
+	size_t z;
+
+	sc = to_vt_drmfb_softc(((struct fb_info *)vd->vd_softc));
+	if (sc == NULL)
+		return;
+
+	vf = vw != NULL ? vw->vw_font : NULL;
+	if (vf == NULL || vf != sc->font) {
+		memset(sc->cells, 0, sizeof(sc->cells));
+		sc->font = vf;
+		sc->miss_row = -1;
+		return;
+	}
+
+	x1 = MAX(x, vw->vw_draw_area.tr_begin.tp_col);
+	y1 = MAX(y, vw->vw_draw_area.tr_begin.tp_row);
+	x2 = MIN(x + width, vw->vw_draw_area.tr_end.tp_col);
+	y2 = MIN(y + height, vw->vw_draw_area.tr_end.tp_row);
+	if (x2 <= x1 || y2 <= y1)
+		return;
+
+	row1 = (y1 - vw->vw_draw_area.tr_begin.tp_row) / vf->vf_height;
+	row2 = MIN(howmany(y2 - vw->vw_draw_area.tr_begin.tp_row,
+	    vf->vf_height), PIXEL_HEIGHT(VT_FB_MAX_HEIGHT));
+	col1 = (x1 - vw->vw_draw_area.tr_begin.tp_col) / vf->vf_width;
+	col2 = MIN(howmany(x2 - vw->vw_draw_area.tr_begin.tp_col,
+	    vf->vf_width), PIXEL_WIDTH(VT_FB_MAX_WIDTH));
+
+	for (row = row1; row < row2; ++row) {
+		for (col = col1; col < col2; ++col) {
+			z = row * PIXEL_WIDTH(VT_FB_MAX_WIDTH) + col;
+			sc->cells[z].valid = false;
+		}
+	}
+}
+
+static inline bool
+vt_drmfb_cell_equal(const struct vt_device *vd, size_t z,
+    const struct vt_drmfb_cell *cell)
+{
+	return (cell->valid &&
+	    cell->c == vd->vd_drawn[z] &&
+	    cell->fg == vd->vd_drawnfg[z] &&
+	    cell->bg == vd->vd_drawnbg[z]);
+}
+
+/*
+ * Returns true if the new content of text row `row`, as recorded by vt(4) in
+ * `vd_drawn`, is what is currently displayed on row `src`.
+ */
+static bool
+vt_drmfb_row_equal(const struct vt_device *vd, struct vt_drmfb_softc *sc,
+    unsigned int row, unsigned int src, unsigned int cols)
+{
+	unsigned int col;
+	size_t z, zsrc;
+
+	z = row * PIXEL_WIDTH(VT_FB_MAX_WIDTH);
+	zsrc = src * PIXEL_WIDTH(VT_FB_MAX_WIDTH);
+	for (col = 0; col < cols; ++col)
+		if (!vt_drmfb_cell_equal(vd, z + col, &sc->cells[zsrc + col]))
+			return (false);
+
+	return (true);
+}
+
+/*
+ * vt(4) has no scrolling primitive: when the console scrolls, every text
+ * cell changes and is redrawn glyph by glyph. Instead, when a cell of a row
+ * needs to be redrawn, look for the new content of this row further down the
+ * screen. If we find it, move as many consecutive rows as possible
+ * with a single copyarea and update the cell cache: the glyphs already in
+ * place are then skipped and only the new lines are drawn. The copy happens
+ * in the shadow buffer, so reading back is cheap.
+ *
+ * Returns true if the cell at `row`, `col` already shows what vt(4) wants.
+ */
+static bool
+vt_drmfb_cell_scroll(struct vt_device *vd, const struct vt_window *vw,
+    struct linux_fb_info *info, unsigned int row, unsigned int col)
+{
+	struct vt_drmfb_softc *sc;
+	const struct vt_font *vf;
+	struct fb_copyarea area;
+	unsigned int rows, cols, offset, count, i;
+	size_t z;
+
+	sc = info->fb_vt_softc;
+	vf = vw->vw_font;
+
+	z = row * PIXEL_WIDTH(VT_FB_MAX_WIDTH) + col;
+	if (vt_drmfb_cell_equal(vd, z, &sc->cells[z]))
+		return (true);
+
+	if (sc->miss_row == (int)row)
+		return (false);
+
+	rows = MIN((vw->vw_draw_area.tr_end.tp_row -
+	    vw->vw_draw_area.tr_begin.tp_row) / vf->vf_height,
+	    PIXEL_HEIGHT(VT_FB_MAX_HEIGHT));
+	cols = MIN((vw->vw_draw_area.tr_end.tp_col -
+	    vw->vw_draw_area.tr_begin.tp_col) / vf->vf_width,
+	    PIXEL_WIDTH(VT_FB_MAX_WIDTH));
+	if (row + 1 >= rows || cols == 0)
+		return (false);
+
+	/* Find where the new content of this row is displayed, if at all. */
+	offset = sc->scroll_offset;
+	if (offset == 0 || row + offset >= rows ||
+	    !vt_drmfb_row_equal(vd, sc, row, row + offset, cols)) {
+		for (offset = 1; row + offset < rows; ++offset)
+			if (vt_drmfb_row_equal(vd, sc, row, row + offset, cols))
+				break;
+		if (row + offset >= rows) {
+			/* Don't search again for the other cells of this row. */
+			sc->miss_row = (int)row;
+			return (false);
+		}
+	}
+	sc->scroll_offset = offset;
+	sc->miss_row = -1;
+
+	/* Extend to all the following rows moving by the same offset. */
+	for (count = 1; row + count + offset < rows; ++count)
+		if (!vt_drmfb_row_equal(vd, sc,
+		    row + count, row + count + offset, cols))
+			break;
+
+	area.sx = vw->vw_draw_area.tr_begin.tp_col;
+	area.sy = vw->vw_draw_area.tr_begin.tp_row +
+	    (row + offset) * vf->vf_height;
+	area.dx = area.sx;
+	area.dy = vw->vw_draw_area.tr_begin.tp_row + row * vf->vf_height;
+	area.width = cols * vf->vf_width;
+	area.height = count * vf->vf_height;
+
+	vt_drmfb_shadow_copyarea(sc, &area);
+
+	for (i = 0; i < count; ++i)
+		memmove(&sc->cells[(row + i) * PIXEL_WIDTH(VT_FB_MAX_WIDTH)],
+		    &sc->cells[(row + i + offset) * PIXEL_WIDTH(VT_FB_MAX_WIDTH)],
+		    cols * sizeof(sc->cells[0]));
+
+	return (vt_drmfb_cell_equal(vd, z, &sc->cells[z]));
+}
+
 void
 vt_drmfb_setpixel(struct vt_device *vd, int x, int y, term_color_t color)
 {
@@ -116,11 +601,13 @@ vt_drmfb_drawrect(
 {
 	struct fb_info *fbio;
 	struct linux_fb_info *info;
+	struct vt_drmfb_softc *sc;
 	struct fb_fillrect rect;
 
 	fbio = vd->vd_softc;
 	info = to_linux_fb_info(fbio);
-	if (info->fbops->fb_fillrect == NULL)
+	sc = info->fb_vt_softc;
+	if (sc == NULL || sc->shadow.base == NULL)
 		return;
 
 	KASSERT(
@@ -142,7 +629,10 @@ vt_drmfb_drawrect(
 	rect.color = fbio->fb_cmap[color];
 	rect.rop = ROP_COPY;
 
-	info->fbops->fb_fillrect(info, &rect);
+	vt_drmfb_cells_invalidate(vd, vd->vd_curwindow,
+	    rect.dx, rect.dy, rect.width, rect.height);
+
+	vt_drmfb_shadow_fillrect(sc, &rect);
 }
 
 void
@@ -171,13 +661,50 @@ vt_drmfb_bitblt_bitmap(struct vt_device *vd, const struct vt_window *vw,
 {
 	struct fb_info *fbio;
 	struct linux_fb_info *info;
+	struct vt_drmfb_softc *sc;
+	const struct vt_font *vf;
 	struct fb_image image;
+	unsigned int row, col;
+	size_t z;
+	bool is_cell;
 
 	fbio = vd->vd_softc;
 	info = to_linux_fb_info(fbio);
-	if (info->fbops->fb_imageblit == NULL)
+	sc = info->fb_vt_softc;
+	if (sc == NULL || sc->shadow.base == NULL)
 		return;
 
+	/*
+	 * Glyphs drawn by vt(4) for a text cell are tracked in the cell cache
+	 * so that scrolling can move them instead of drawing them again.
+	 * Anything else (the mouse pointer, a logo) invalidates the cells it
+	 * overlaps.
+	 */
+	vf = vw->vw_font;
+	is_cell = false;
+	if (vf != NULL && vf != sc->font)
+		vt_drmfb_cells_invalidate(vd, vw, 0, 0, 0, 0);
+	if (vf != NULL && mask == NULL &&
+	    vd->vd_drawn != NULL && vd->vd_drawnfg != NULL &&
+	    vd->vd_drawnbg != NULL &&
+	    (fbio->fb_flags & FB_FLAG_NOWRITE) == 0 &&
+	    width == vf->vf_width && height == vf->vf_height &&
+	    x >= vw->vw_draw_area.tr_begin.tp_col &&
+	    y >= vw->vw_draw_area.tr_begin.tp_row &&
+	    (x - vw->vw_draw_area.tr_begin.tp_col) % vf->vf_width == 0 &&
+	    (y - vw->vw_draw_area.tr_begin.tp_row) % vf->vf_height == 0) {
+		row = (y - vw->vw_draw_area.tr_begin.tp_row) / vf->vf_height;
+		col = (x - vw->vw_draw_area.tr_begin.tp_col) / vf->vf_width;
+		is_cell = row < PIXEL_HEIGHT(VT_FB_MAX_HEIGHT) &&
+		    col < PIXEL_WIDTH(VT_FB_MAX_WIDTH);
+	}
+	if (is_cell) {
+		if (vt_drmfb_cell_scroll(vd, vw, info, row, col))
+			return;
+	} else {
+		vt_drmfb_cells_invalidate(vd, vw, x, y, width, height);
+	}
+
 	/* Bound by right and bottom edges. */
 	if (y + height > vw->vw_draw_area.tr_end.tp_row) {
 		if (y >= vw->vw_draw_area.tr_end.tp_row)
@@ -200,10 +727,15 @@ vt_drmfb_bitblt_bitmap(struct vt_device *vd, const struct vt_window *vw,
 	image.data = pattern;
 	image.mask = mask; // Specific to FreeBSD to display the mouse pointer.
 
-	if (!kdb_active && !KERNEL_PANICKED())
-		linux_set_current(curthread);
+	vt_drmfb_shadow_imageblit(sc, &image);
 
-	info->fbops->fb_imageblit(info, &image);
+	if (is_cell) {
+		z = row * PIXEL_WIDTH(VT_FB_MAX_WIDTH) + col;
+		sc->cells[z].c = vd->vd_drawn[z];
+		sc->cells[z].fg = vd->vd_drawnfg[z];
+		sc->cells[z].bg = vd->vd_drawnbg[z];
+		sc->cells[z].valid = true;
+	}
 }
 
 void
@@ -215,6 +747,15 @@ vt_drmfb_postswitch(struct vt_device *vd)
 	fbio = vd->vd_softc;
 	info = to_linux_fb_info(fbio);
 
+	/*
+	 * The screen content is about to be redrawn from scratch, and the
+	 * framebuffer may have been overwritten behind our back: don't trust
+	 * what we think is displayed.
+	 */
+	vt_drmfb_cells_invalidate(vd, NULL, 0, 0, 0, 0);
+	if (info->fb_vt_softc != NULL && info->fb_vt_softc->shadow.base != NULL)
+		vt_drmfb_damage_all(info->fb_vt_softc);
+
 	if (!kdb_active && !KERNEL_PANICKED()) {
 		taskqueue_enqueue(taskqueue_thread, &info->fb_mode_task);
 
@@ -246,9 +787,12 @@ vt_drmfb_postswitch(struct vt_device *vd)
 void
 vt_drmfb_invalidate_text(struct vt_device *vd, const term_rect_t *area)
 {
+	struct vt_drmfb_softc *sc;
 	unsigned int col, row;
 	size_t z;
 
+	sc = to_vt_drmfb_softc(((struct fb_info *)vd->vd_softc));
+
 	for (row = area->tr_begin.tp_row; row < area->tr_end.tp_row; ++row) {
 		for (col = area->tr_begin.tp_col; col < area->tr_end.tp_col;
 		    ++col) {
@@ -264,6 +808,8 @@ vt_drmfb_invalidate_text(struct vt_device *vd, const term_rect_t *area)
 				vd->vd_drawnbg[z] = 0;
 			if (vd->vd_pos_to_flush)
 				vd->vd_pos_to_flush[z] = true;
+			if (sc != NULL)
+				sc->cells[z].valid = false;
 		}
 	}
 }
@@ -340,12 +886,75 @@ vt_drmfb_fini(struct vt_device *vd, void *softc)
 	vd->vd_video_dev = NULL;
 }
 
+static struct vt_drmfb_softc *
+vt_drmfb_softc_alloc(struct linux_fb_info *info)
+{
+	struct vt_drmfb_softc *sc;
+	size_t size;
+
+	sc = malloc(sizeof(*sc), M_VT_DRMFB, M_WAITOK | M_ZERO);
+	sc->info = info;
+	sc->miss_row = -1;
+	mtx_init(&sc->lock, "vt_drmfb", NULL, MTX_DEF);
+	TIMEOUT_TASK_INIT(taskqueue_thread, &sc->flush_task, 0,
+	    vt_drmfb_flush_task, sc);
+
+	if (info->flags & FBINFO_READS_FAST) {
+		linux_fb_surface_init(&sc->shadow, info, info->screen_buffer,
+		    info->fix.smem_len);
+	} else if (info->screen_base != NULL) {
+		size = (size_t)info->fix.line_length * info->var.yres;
+		linux_fb_surface_init(&sc->shadow, info,
+		    malloc(size, M_VT_DRMFB, M_WAITOK | M_ZERO), size);
+		sc->own_shadow = true;
+	}
+
+	sc->scratch_size = MAX(info->fix.line_length, VT_DRMFB_SCRATCH_MIN);
+	sc->scratch = malloc(sc->scratch_size, M_VT_DRMFB, M_WAITOK);
+
+	/*
+	 * The shadow starts out blank and doesn't match what is on screen
+	 * (firmware console, uncleared VRAM): write all of it out once.
+	 */
+	if (sc->shadow.base != NULL)
+		vt_drmfb_damage_all(sc);
+
+	return (sc);
+}
+
+static void
+vt_drmfb_softc_free(struct vt_drmfb_softc *sc)
+{
+	if (sc == NULL)
+		return;
+
+	taskqueue_drain_timeout(taskqueue_thread, &sc->flush_task);
+	if (sc->own_shadow)
+		free(sc->shadow.base, M_VT_DRMFB);
+	free(sc->scratch, M_VT_DRMFB);
+	mtx_destroy(&sc->lock);
+	free(sc, M_VT_DRMFB);
+}
+
 int
 vt_drmfb_attach(struct fb_info *fbio)
 {
+	struct linux_fb_info *info;
 	int ret;
 
+	/*
+	 * vd_init is called with the vt(4) lock held, so the state is
+	 * allocated here, where we can sleep.
+	 */
+	info = to_linux_fb_info(fbio);
+	if (info->fb_vt_softc == NULL)
+		info->fb_vt_softc = vt_drmfb_softc_alloc(info);
+
 	ret = vt_allocate(&vt_drmfb_driver, fbio);
+	if (ret != 0) {
+		vt_drmfb_softc_free(info->fb_vt_softc);
+		info->fb_vt_softc = NULL;
+	}
 
 	return (ret);
 }
@@ -353,10 +962,15 @@ vt_drmfb_attach(struct fb_info *fbio)
 int
 vt_drmfb_detach(struct fb_info *fbio)
 {
+	struct linux_fb_info *info;
 	int ret;
 
 	ret = vt_deallocate(&vt_drmfb_driver, fbio);
 
+	info = to_linux_fb_info(fbio);
+	vt_drmfb_softc_free(info->fb_vt_softc);
+	info->fb_vt_softc = NULL;
+
 	return (ret);
 }
 
@@ -369,5 +983,12 @@ vt_drmfb_suspend(struct vt_device *vd)
 void
 vt_drmfb_resume(struct vt_device *vd)
 {
+	struct vt_drmfb_softc *sc;
+
+	/* The framebuffer content may be lost, flush all of it again. */
+	sc = to_vt_drmfb_softc(((struct fb_info *)vd->vd_softc));
+	if (sc != NULL && sc->shadow.base != NULL)
+		vt_drmfb_damage_all(sc);
+
 	vt_resume(vd);
 }
@@ -41,4 +41,32 @@ void vt_drmfb_resume(struct vt_device *vd);
 void vt_drmfb_suspend(struct vt_device *vd);
 int vt_drmfb_detach(struct fb_info *info);
 
+/*
+ * A memory buffer laid out like a framebuffer. The cfb_*() routines in
+ * linux_fb.c draw through it, and vt_drmfb uses the same code to draw into
+ * its shadow buffer.
+ */
+struct linux_fb_surface {
+	uint8_t		*base;
+	size_t		 size;
+	uint32_t	 line_length;
+	uint32_t	 cpp;		/* Bytes per pixel */
+	uint32_t	 width;
+	uint32_t	 height;
+};
+
+struct linux_fb_info;
+struct fb_fillrect;
+struct fb_copyarea;
+struct fb_image;
+
+void linux_fb_surface_init(struct linux_fb_surface *surf,
+    struct linux_fb_info *info, void *base, size_t size);
+void linux_fb_surface_fillrect(const struct linux_fb_surface *surf,
+    const struct fb_fillrect *rect);
+void linux_fb_surface_copyarea(const struct linux_fb_surface *surf,
+    const struct fb_copyarea *area);
+void linux_fb_surface_imageblit(const struct linux_fb_surface *surf,
+    const struct fb_image *image);
+
 #endif /* _DEV_VT_HW_FB_VT_DRMFB_H_ */
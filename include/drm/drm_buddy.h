@@ -6,8 +6,10 @@
 #ifndef __DRM_BUDDY_H__
 #define __DRM_BUDDY_H__
 
+#include <linux/bitmap.h>
 #include <linux/bitops.h>
 #include <linux/list.h>
+#include <linux/rbtree.h>
 #include <linux/slab.h>
 #include <linux/sched.h>
 
@@ -50,8 +52,13 @@ struct drm_buddy_block {
 	 */
 	struct list_head link;
 	struct list_head tmp_link;
+
+	/* Node in the free tree of its order while the block is free. */
+	struct rb_node rb;
 };
 
+struct drm_buddy_magazine;
+
 /* Order-zero must be at least PAGE_SIZE */
 #define DRM_BUDDY_MAX_ORDER (63 - PAGE_SHIFT)
 
@@ -62,18 +69,26 @@ struct drm_buddy_block {
  * drm_buddy_alloc* and drm_buddy_free* should suffice.
  */
 struct drm_buddy {
-	/* Maintain a free list for each order. */
-	struct list_head *free_list;
+	/*
+	 * Maintain a free tree for each order, sorted by descending offset so
+	 * that the cached leftmost node is the highest free block, and a
+	 * bitmap of the orders with a non-empty tree.
+	 */
+	struct rb_root_cached *free_tree;
+	DECLARE_BITMAP(free_orders, DRM_BUDDY_MAX_ORDER + 1);
 
 	/*
 	 * Maintain explicit binary tree(s) to track the allocation of the
 	 * address space. This gives us a simple way of finding a buddy block
 	 * and performing the potentially recursive merge step when freeing a
 	 * block.  Nodes are either allocated or free, in which case they will
-	 * also exist on the respective free list.
+	 * also exist in the respective free tree.
 	 */
 	struct drm_buddy_block **roots;
 
+	/* Optional cache of small blocks, see drm_buddy_cache_init(). */
+	struct drm_buddy_magazine *cache;
+
 	/*
 	 * Anything from here is public, and remains static for the lifetime of
 	 * the mm. Everything above is considered do-not-touch.
@@ -134,6 +149,8 @@ int drm_buddy_init(struct drm_buddy *mm, u64 size, u64 chunk_size);
 
 void drm_buddy_fini(struct drm_buddy *mm);
 
+int drm_buddy_cache_init(struct drm_buddy *mm);
+
 struct drm_buddy_block *
 drm_get_buddy(struct drm_buddy_block *block);
 
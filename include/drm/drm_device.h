@@ -307,6 +307,7 @@ struct drm_device {
 
 #ifdef __FreeBSD__
 	struct drm_sysctl_info *sysctl;
+	struct drm_stats *stats;
 	int  sysctl_node_idx;
 	void *sysctl_private;
 	char busid_str[128];
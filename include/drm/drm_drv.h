@@ -44,6 +44,10 @@ struct drm_display_mode;
 struct drm_mode_create_dumb;
 struct drm_printer;
 struct sg_table;
+#ifdef __FreeBSD__
+struct sysctl_ctx_list;
+struct sysctl_oid;
+#endif
 
 /**
  * enum drm_driver_feature - feature flags
@@ -392,6 +396,19 @@ struct drm_driver {
 	 */
 	void (*show_fdinfo)(struct drm_printer *p, struct drm_file *f);
 
+#ifdef __FreeBSD__
+	/**
+	 * @stats_sysctl_init:
+	 *
+	 * Optional hook to add driver counters, such as TTM pool or
+	 * scheduler ring statistics, below the hw.dri.N.stats sysctl node.
+	 * Called at the end of drm_dev_register().
+	 */
+	void (*stats_sysctl_init)(struct drm_device *dev,
+				  struct sysctl_ctx_list *ctx,
+				  struct sysctl_oid *node);
+#endif
+
 	/** @major: driver major number */
 	int major;
 	/** @minor: driver minor number */
@@ -67,4 +67,8 @@ size_t drm_fb_build_fourcc_list(struct drm_device *dev,
 				const u32 *native_fourccs, size_t native_nfourccs,
 				u32 *fourccs_out, size_t nfourccs_out);
 
+#ifdef __FreeBSD__
+void drm_format_helper_init_early(void);
+#endif
+
 #endif /* __LINUX_DRM_FORMAT_HELPER_H */
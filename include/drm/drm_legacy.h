@@ -34,6 +34,7 @@
  */
 
 #include <linux/agp_backend.h>
+#include <linux/seqlock.h>
 
 #include <drm/drm.h>
 #include <drm/drm_auth.h>
@@ -59,9 +60,14 @@ struct drm_hash_item {
 	unsigned long key;
 };
 
+struct drm_ht_table;
+
 struct drm_open_hash {
-	struct hlist_head *table;
-	u8 order;
+	struct drm_ht_table __rcu *table;
+	seqcount_t resize_seq;	/* bumped while entries move between tables */
+	unsigned int count;	/* number of hashed items */
+	unsigned int resizes;	/* number of times the table has grown */
+	u8 order;		/* initial order, the table never shrinks below */
 };
 
 /**
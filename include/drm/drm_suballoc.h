@@ -18,16 +18,22 @@
  * @hole: Pointer to first hole node.
  * @olist: List of allocated ranges.
  * @flist: Array[fence context hash] of queues of fenced allocated ranges.
+ * @start: Start offset of the managed range.
  * @size: Size of the managed range.
  * @align: Default alignment for the managed range.
+ * @shards: Sub-managers splitting the range in sharded mode, or NULL.
+ * @num_shards: Number of entries in @shards.
  */
 struct drm_suballoc_manager {
 	wait_queue_head_t wq;
 	struct list_head *hole;
 	struct list_head olist;
 	struct list_head flist[DRM_SUBALLOC_MAX_QUEUES];
+	size_t start;
 	size_t size;
 	size_t align;
+	struct drm_suballoc_manager *shards;
+	unsigned int num_shards;
 };
 
 /**
@@ -51,6 +57,10 @@ struct drm_suballoc {
 void drm_suballoc_manager_init(struct drm_suballoc_manager *sa_manager,
 			       size_t size, size_t align);
 
+int drm_suballoc_manager_init_sharded(struct drm_suballoc_manager *sa_manager,
+				      size_t size, size_t align,
+				      unsigned int num_shards);
+
 void drm_suballoc_manager_fini(struct drm_suballoc_manager *sa_manager);
 
 struct drm_suballoc *
@@ -49,10 +49,19 @@ struct drm_vma_offset_file {
 	unsigned long vm_count;
 };
 
+/*
+ * Number of open-files tracked inline in each node. Almost every object is
+ * only ever mapped through one or two files, which can then be checked
+ * without taking the node lock.
+ */
+#define DRM_VMA_NODE_INLINE_FILES 2
+
 struct drm_vma_offset_node {
 	rwlock_t vm_lock;
 	struct drm_mm_node vm_node;
 	struct rb_root vm_files;
+	struct drm_file *vm_inline_tag[DRM_VMA_NODE_INLINE_FILES];
+	unsigned long vm_inline_count[DRM_VMA_NODE_INLINE_FILES];
 	void *driver_private;
 };
 
@@ -81,6 +81,9 @@ extern int drm_sched_policy;
 #define DRM_SCHED_POLICY_RR    0
 #define DRM_SCHED_POLICY_FIFO  1
 
+/* Cleanup passes are counted in log2 buckets of 1, 2-3, ..., 128+ jobs */
+#define DRM_SCHED_CLEANUP_BUCKETS	8
+
 /**
  * struct drm_sched_entity - A wrapper around a job queue (typically
  * attached to the DRM file_priv).
@@ -487,6 +490,12 @@ struct drm_sched_backend_ops {
  * @work_tdr: schedules a delayed call to @drm_sched_job_timedout after the
  *            timeout interval is over.
  * @thread: the kthread on which the scheduler which run.
+ * @free_wq: workqueue used to queue @work_free_job, NULL if finished jobs
+ *           are freed by @thread.
+ * @work_free_job: frees the finished jobs of the @pending_list.
+ * @pause_free: set while @work_free_job must not touch the @pending_list.
+ * @cleanup_batches: log2 histogram of the number of jobs retired per cleanup
+ *                   pass, protected by @job_list_lock.
  * @pending_list: the list of jobs which are currently in the job queue.
  * @job_list_lock: lock to protect the pending_list.
  * @hang_limit: once the hangs by a job crosses this limit then it is marked
@@ -512,8 +521,12 @@ struct drm_gpu_scheduler {
 	struct workqueue_struct		*timeout_wq;
 	struct delayed_work		work_tdr;
 	struct task_struct		*thread;
+	struct workqueue_struct		*free_wq;
+	struct work_struct		work_free_job;
+	bool				pause_free;
 	struct list_head		pending_list;
 	spinlock_t			job_list_lock;
+	u64				cleanup_batches[DRM_SCHED_CLEANUP_BUCKETS];
 	int				hang_limit;
 	atomic_t                        *score;
 	atomic_t                        _score;
@@ -529,6 +542,13 @@ int drm_sched_init(struct drm_gpu_scheduler *sched,
 		   atomic_t *score, const char *name, struct device *dev);
 
 void drm_sched_fini(struct drm_gpu_scheduler *sched);
+#ifdef __FreeBSD__
+struct sysctl_ctx_list;
+struct sysctl_oid;
+void drm_sched_sysctl_init(struct drm_gpu_scheduler *sched,
+			   struct sysctl_ctx_list *ctx,
+			   struct sysctl_oid *parent);
+#endif
 int drm_sched_job_init(struct drm_sched_job *job,
 		       struct drm_sched_entity *entity,
 		       void *owner);
@@ -127,6 +127,23 @@ struct ttm_buffer_object {
 	 */
 	struct work_struct delayed_delete;
 
+	/**
+	 * @evicted_from: The resource manager the BO was last evicted from,
+	 * used to count BOs thrashing in and out of it.
+	 */
+	struct ttm_resource_manager *evicted_from;
+
+	/**
+	 * @prefault: State of the adaptive prefault window, protected by
+	 * the reserve lock like the rest of the fault handling.
+	 */
+	struct {
+		/** @prefault.next: Page offset after the last mapped range */
+		pgoff_t next;
+		/** @prefault.window: Current window size, 0 for the default */
+		pgoff_t window;
+	} prefault;
+
 	/**
 	 * Special members that are protected by the reserve lock
 	 * and the bo::lock when written to. Can be read with
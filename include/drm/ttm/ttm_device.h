@@ -266,6 +266,12 @@ struct ttm_device {
 	 * @wq: Work queue structure for the delayed delete workqueue.
 	 */
 	struct workqueue_struct *wq;
+
+	/**
+	 * @reclaim_work: Background eviction from the resource managers
+	 * above their high watermark, runs on @wq.
+	 */
+	struct delayed_work reclaim_work;
 };
 
 int ttm_global_swapout(struct ttm_operation_ctx *ctx, gfp_t gfp_flags);
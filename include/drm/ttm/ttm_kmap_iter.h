@@ -40,6 +40,33 @@ struct ttm_kmap_iter_ops {
 	 */
 	void (*unmap_local)(struct ttm_kmap_iter *res_iter,
 			    struct iosys_map *dmap);
+	/**
+	 * map_local_range() - Optionally map a virtually contiguous run of
+	 * PAGE_SIZE parts of the resource using kmap_local semantics.
+	 * @res_iter: Pointer to the struct ttm_kmap_iter representing
+	 * the resource.
+	 * @dmap: The struct iosys_map holding the virtual address after
+	 * the operation.
+	 * @i: The location within the resource to map. PAGE_SIZE granularity.
+	 * @max_pages: The maximum number of pages to map.
+	 *
+	 * Return: The number of pages mapped, at least one.
+	 */
+	unsigned long (*map_local_range)(struct ttm_kmap_iter *res_iter,
+					 struct iosys_map *dmap, pgoff_t i,
+					 unsigned long max_pages);
+	/**
+	 * unmap_local_range() - Unmap a run previously mapped using
+	 * map_local_range.
+	 * @res_iter: Pointer to the struct ttm_kmap_iter representing
+	 * the resource.
+	 * @dmap: The struct iosys_map holding the virtual address after
+	 * the operation.
+	 * @num_pages: The number of pages map_local_range returned.
+	 */
+	void (*unmap_local_range)(struct ttm_kmap_iter *res_iter,
+				  struct iosys_map *dmap,
+				  unsigned long num_pages);
 	bool maps_tt;
 };
 
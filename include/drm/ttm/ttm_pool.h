@@ -29,6 +29,9 @@
 #include <linux/mmzone.h>
 #include <linux/llist.h>
 #include <linux/spinlock.h>
+#ifdef __FreeBSD__
+#include <linux/rbtree.h>
+#endif
 #include <drm/ttm/ttm_caching.h>
 
 struct device;
@@ -45,6 +48,10 @@ struct ttm_operation_ctx;
  * @shrinker_list: our place on the global shrinker list
  * @lock: protection of the page list
  * @pages: the list of pages in the pool
+ * @nr_pages: number of pages on @pages, protected by @lock
+ * @hits: allocations of this order served from @pages
+ * @misses: allocations of this order which had to allocate new pages
+ * @remote: allocations served from @pages for a pool of another domain
  */
 struct ttm_pool_type {
 	struct ttm_pool *pool;
@@ -58,6 +65,10 @@ struct ttm_pool_type {
 	struct list_head pages;
 #elif defined(__FreeBSD__)
 	struct pglist pages;
+	unsigned long nr_pages;
+	atomic_long_t hits;
+	atomic_long_t misses;
+	atomic_long_t remote;
 #endif
 };
 
@@ -69,6 +80,9 @@ struct ttm_pool_type {
  * @use_dma_alloc: if coherent DMA allocations should be used
  * @use_dma32: if GFP_DMA32 should be used
  * @caching: pools for each caching/order
+ * @domain: the memory domain local to @dev
+ * @dma_lock: protection of @dma_pages
+ * @dma_pages: coherent DMA mappings of the pages allocated by this pool
  */
 struct ttm_pool {
 	struct device *dev;
@@ -80,6 +94,12 @@ struct ttm_pool {
 	struct {
 		struct ttm_pool_type orders[MAX_ORDER + 1];
 	} caching[TTM_NUM_CACHING_TYPES];
+
+#ifdef __FreeBSD__
+	int domain;
+	spinlock_t dma_lock;
+	struct rb_root dma_pages;
+#endif
 };
 
 int ttm_pool_alloc(struct ttm_pool *pool, struct ttm_tt *tt,
@@ -91,6 +111,12 @@ void ttm_pool_init(struct ttm_pool *pool, struct device *dev,
 void ttm_pool_fini(struct ttm_pool *pool);
 
 int ttm_pool_debugfs(struct ttm_pool *pool, struct seq_file *m);
+#ifdef __FreeBSD__
+struct sysctl_ctx_list;
+struct sysctl_oid;
+void ttm_pool_sysctl_init(struct ttm_pool *pool, struct sysctl_ctx_list *ctx,
+			  struct sysctl_oid *parent);
+#endif
 
 int ttm_pool_mgr_init(unsigned long num_pages);
 void ttm_pool_mgr_fini(void);
@@ -38,6 +38,9 @@
 #define TTM_MAX_BO_PRIORITY	4U
 #define TTM_NUM_MEM_TYPES 8
 
+/* Number of generations tracked by the generational LRU */
+#define TTM_LRU_NR_GENS		4U
+
 struct ttm_device;
 struct ttm_resource_manager;
 struct ttm_resource;
@@ -145,6 +148,16 @@ struct ttm_resource_manager_func {
  * @move_lock: lock for move fence
  * @move: The fence of the last pipelined move operation.
  * @lru: The lru list for this memory type.
+ * @lru_gens: Evict by generation instead of plain LRU order, set from the
+ * ttm.lru_gens module parameter.
+ * @lru_gen: The current, youngest generation.
+ * @evictions: Number of BOs evicted from this manager.
+ * @refaults: Number of evicted BOs which came back to this manager.
+ * @reclaim_low: Background reclaim evicts down to this usage.
+ * @reclaim_high: Usage above which background reclaim kicks in, 0 if off.
+ * @reclaim_runs: Number of background reclaim runs.
+ * @reclaimed: Usage freed by background reclaim.
+ * @reclaim_failed: Background reclaim runs which backed off on an error.
  *
  * This structure is used to identify and manage memory types for a device.
  */
@@ -174,6 +187,25 @@ struct ttm_resource_manager {
 	 * bdev->lru_lock.
 	 */
 	uint64_t usage;
+
+	/*
+	 * Generational LRU state and thrash counters, protected by the
+	 * bdev->lru_lock.
+	 */
+	bool lru_gens;
+	uint32_t lru_gen;
+	uint64_t evictions;
+	uint64_t refaults;
+
+	/*
+	 * Background reclaim watermarks in the units of @usage and progress,
+	 * protected by the bdev->lru_lock.
+	 */
+	uint64_t reclaim_low;
+	uint64_t reclaim_high;
+	uint64_t reclaim_runs;
+	uint64_t reclaimed;
+	uint64_t reclaim_failed;
 };
 
 /**
@@ -202,6 +234,8 @@ struct ttm_bus_placement {
  * @placement: Placement flags.
  * @bus: Placement on io bus accessible to the CPU
  * @bo: weak reference to the BO, protected by ttm_device::lru_lock
+ * @lru_gen: Generation of the manager when the resource was last used
+ * @lru_tier: Extra generations of protection after a refault
  *
  * Structure indicating the placement and space resources used by a
  * buffer object.
@@ -218,17 +252,25 @@ struct ttm_resource {
 	 * @lru: Least recently used list, see &ttm_resource_manager.lru
 	 */
 	struct list_head lru;
+
+	/* Protected by ttm_device::lru_lock */
+	uint32_t lru_gen;
+	uint32_t lru_tier;
 };
 
 /**
  * struct ttm_resource_cursor
  *
  * @priority: the current priority
+ * @age: the current generation age, counting down from the oldest
+ * @younger: mask of the younger ages seen on the current priority list
  *
  * Cursor to iterate over the resources in a manager.
  */
 struct ttm_resource_cursor {
 	unsigned int priority;
+	unsigned int age;
+	unsigned int younger;
 };
 
 /**
@@ -350,6 +392,10 @@ void ttm_resource_add_bulk_move(struct ttm_resource *res,
 void ttm_resource_del_bulk_move(struct ttm_resource *res,
 				struct ttm_buffer_object *bo);
 void ttm_resource_move_to_lru_tail(struct ttm_resource *res);
+void ttm_resource_manager_evicted(struct ttm_resource_manager *man,
+				  struct ttm_buffer_object *bo);
+void ttm_resource_manager_set_watermarks(struct ttm_resource_manager *man,
+					 uint64_t low, uint64_t high);
 
 void ttm_resource_init(struct ttm_buffer_object *bo,
                        const struct ttm_place *place,
@@ -37,6 +37,7 @@ struct ttm_tt;
 struct ttm_resource;
 struct ttm_buffer_object;
 struct ttm_operation_ctx;
+struct ttm_zstore;
 
 /**
  * struct ttm_tt - This is a structure holding the pages, caching- and aperture
@@ -104,6 +105,11 @@ struct ttm_tt {
 	dma_addr_t *dma_address;
 	/** @swap_storage: Pointer to shmem struct file for swap storage. */
 	struct file *swap_storage;
+	/**
+	 * @swap_zstore: Compressed in-memory swap storage, used instead of
+	 * @swap_storage when ttm.swap_compress is enabled.
+	 */
+	struct ttm_zstore *swap_zstore;
 	/**
 	 * @caching: The current caching state of the pages, see enum
 	 * ttm_caching.
@@ -20,6 +20,9 @@
 
 struct linux_fb_info;
 struct videomode;
+#ifdef __FreeBSD__
+struct vt_drmfb_softc;
+#endif
 struct vm_area_struct;
 
 struct fb_blit_caps {
@@ -149,6 +152,7 @@ struct linux_fb_info {
 	struct fb_info fbio;
 	device_t fb_bsddev;
 	struct task fb_mode_task;
+	struct vt_drmfb_softc *fb_vt_softc;	/* vt_drmfb private state */
 
 	/* i915 fictitious pages area */
 	resource_size_t aperture_base;